@@ -0,0 +1,171 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// alignment of allocations that don't ask for more, enough for SSE loads of matrices
+const size_t ARENA_ALIGNMENT = 16;
+
+// with ARENA_DEBUG, fresh allocations read as 0xcd and released memory as 0xdd, so a stale
+// pointer into an earlier frame shows up as garbage rather than as plausible old data
+const unsigned char ARENA_POISON_ALLOCATED = 0xcd;
+const unsigned char ARENA_POISON_RELEASED = 0xdd;
+
+// linear allocator for data that lives until the next reset
+//
+// allocating bumps an offset and reset releases everything at once, nothing is freed on its
+// own and no destructors run, so only trivially destructible types belong here. when the block
+// runs out the allocation falls back to the heap and the next reset grows the block to twice
+// the high water mark, so a steady frame loop stops touching the heap after its first frames.
+class Arena
+{
+  public:
+    // most bytes in use between two resets, including heap fallbacks
+    size_t highWater = 0;
+
+    // allocations that didn't fit in the block since create
+    unsigned int overflows = 0;
+
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        destroy();
+    }
+
+    void create(size_t capacity)
+    {
+        destroy();
+
+        size = capacity > 0 ? capacity : ARENA_ALIGNMENT;
+        block = (unsigned char *)aligned_alloc(ARENA_ALIGNMENT, align(size, ARENA_ALIGNMENT));
+
+        if (block == NULL)
+            throw std::bad_alloc();
+    }
+
+    void *allocate(size_t bytes, size_t alignment = ARENA_ALIGNMENT)
+    {
+        size_t start = align(offset, alignment);
+        void *memory;
+
+        if (start + bytes <= size)
+        {
+            memory = block + start;
+            offset = start + bytes;
+        }
+        else
+        {
+            memory = aligned_alloc(alignment, align(bytes > 0 ? bytes : 1, alignment));
+
+            if (memory == NULL)
+                throw std::bad_alloc();
+
+            overflow.push_back(memory);
+            overflowBytes += bytes;
+            overflows++;
+        }
+
+#ifdef ARENA_DEBUG
+        memset(memory, ARENA_POISON_ALLOCATED, bytes);
+#endif
+
+        size_t total = offset + overflowBytes;
+        highWater = total > highWater ? total : highWater;
+
+        return memory;
+    }
+
+    template <typename T> T *allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is released without destructors");
+        return (T *)allocate(count * sizeof(T), alignof(T));
+    }
+
+    // construct a copy of value in the arena
+    template <typename T> T *copy(const T &value)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is released without destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(value);
+    }
+
+    // release every allocation, growing the block if the last use didn't fit
+    void reset()
+    {
+#ifdef ARENA_DEBUG
+        if (block != NULL)
+            memset(block, ARENA_POISON_RELEASED, offset);
+#endif
+
+        if (!overflow.empty())
+        {
+            for (void *memory : overflow)
+                free(memory);
+
+            overflow.clear();
+            create(highWater * 2);
+        }
+
+        offset = 0;
+        overflowBytes = 0;
+    }
+
+    size_t used() const
+    {
+        return offset + overflowBytes;
+    }
+
+    size_t capacity() const
+    {
+        return size;
+    }
+
+    void destroy()
+    {
+        for (void *memory : overflow)
+            free(memory);
+
+        overflow.clear();
+        free(block);
+
+        block = NULL;
+        size = 0;
+        offset = 0;
+        overflowBytes = 0;
+    }
+
+    // one line of capacity, high water mark and overflow count
+    void report(FILE *file, const char *name) const
+    {
+        fprintf(file, "%-12s %10.1f %10.1f %10u\n", name, size / 1024.0, highWater / 1024.0, overflows);
+    }
+
+  private:
+    unsigned char *block = NULL;
+    size_t size = 0;
+    size_t offset = 0;
+
+    std::vector<void *> overflow;
+    size_t overflowBytes = 0;
+
+    static size_t align(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+};
+
+inline void report_arena_header(FILE *file)
+{
+    fprintf(file, "%-12s %10s %10s %10s\n", "arena", "kb", "high kb", "overflows");
+}
+
+#endif
@@ -0,0 +1,779 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include "libs/glad.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "compression.h"
+#include "glstate.h"
+#include "mipmap.h"
+#include "pixelbuffer.h"
+#include "threadpool.h"
+#include "util.h"
+
+// largest side of a skyline packed page, every page is one layer of the array texture
+const int ATLAS_PAGE_SIZE = 2048;
+
+// border of repeated edge texels around each packed image, so filtering never reaches a neighbour
+const int ATLAS_PADDING = 4;
+
+// packed pages stop their mip chain while the padding is still a texel wide
+const int ATLAS_MAX_LEVEL = 2;
+
+// packed images start on multiples of this, so their borders stay on texel edges down to ATLAS_MAX_LEVEL
+const int ATLAS_ALIGNMENT = 1 << ATLAS_MAX_LEVEL;
+
+// packed atlases are kept here, keyed by their source files and the device limits they were packed for
+const char *const ATLAS_CACHE_DIRECTORY = "./cache/atlases";
+
+// bump when the packing or the encoding changes so stale cache files are rebuilt
+const uint32_t ATLAS_CACHE_VERSION = 3;
+
+const uint32_t ATLAS_CACHE_MAGIC = 0x534c5441; // "ATLS"
+
+// enough mip levels for a 32768 texel side
+const unsigned int ATLAS_CACHE_MAX_LEVELS = 16;
+
+// packed images whose mip chains one job builds
+const size_t ATLAS_CELLS_PER_JOB = 32;
+
+// rows of 4x4 blocks one job compresses
+const size_t ATLAS_BLOCK_ROWS_PER_JOB = 8;
+
+// where an image sits in the array texture, read by the vertex shader as two RGBA32F texels
+struct AtlasRegion
+{
+    // corner and extent of the image in uv, texture coordinates in [0, 1] map onto it
+    float u, v;
+    float width, height;
+
+    float layer;
+    float unused[3];
+};
+
+enum class AtlasLayout : uint32_t
+{
+    // one image per layer in its corner, for images that all share a size
+    Layers,
+    // padded images skyline packed into as few layers as fit them
+    Skyline
+};
+
+// decoded RGBA8 pixels, bottom row first like stb_image flipped on load
+struct AtlasImage
+{
+    const unsigned char *pixels;
+    int width, height;
+};
+
+// device limits the packing has to respect
+struct AtlasLimits
+{
+    int maxSize;
+    int maxLayers;
+};
+
+// one mip level of every layer, in bytes from the start of the atlas pixels
+struct AtlasLevel
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+// header of a cached atlas file, laid out after KTX2: a level index into the pixel data, which holds
+// each level's layers back to back ready for the gpu, and the regions in a block of their own
+struct AtlasCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+
+    uint32_t layout;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    uint32_t levelCount;
+    uint32_t regionCount;
+    uint32_t reserved;
+
+    uint64_t regionOffset;
+    uint64_t pixelOffset;
+    AtlasLevel levels[ATLAS_CACHE_MAX_LEVELS];
+};
+
+// bottom-left skyline packer for one page
+//
+// the top edge of everything placed so far is kept as a list of horizontal segments. a rectangle
+// goes where its top ends lowest, resting on the highest segment under it, which wastes little
+// space for the many similarly sized images of a sprite set.
+class SkylinePacker
+{
+  public:
+    void create(int pageWidth, int pageHeight)
+    {
+        width = pageWidth;
+        height = pageHeight;
+        segments.assign(1, {0, 0, pageWidth});
+    }
+
+    // returns false when the rectangle doesn't fit anywhere on the page
+    bool insert(int rectWidth, int rectHeight, int &x, int &y)
+    {
+        size_t best = segments.size();
+        int bestTop = 0;
+        int bestY = 0;
+
+        for (size_t i = 0; i < segments.size(); i++)
+        {
+            int restY;
+
+            if (!fit(i, rectWidth, rectHeight, restY))
+                continue;
+
+            // ties go to the narrower segment, leaving wide ones for wide images
+            int top = restY + rectHeight;
+
+            if (best == segments.size() || top < bestTop ||
+                (top == bestTop && segments[i].width < segments[best].width))
+            {
+                best = i;
+                bestTop = top;
+                bestY = restY;
+            }
+        }
+
+        if (best == segments.size())
+            return false;
+
+        x = segments[best].x;
+        y = bestY;
+        place(best, rectWidth, bestTop);
+
+        return true;
+    }
+
+  private:
+    struct Segment
+    {
+        int x, y, width;
+    };
+
+    int width = 0;
+    int height = 0;
+    std::vector<Segment> segments;
+
+    // height a rectangle rests at with its left edge on segment index
+    bool fit(size_t index, int rectWidth, int rectHeight, int &y) const
+    {
+        if (segments[index].x + rectWidth > width)
+            return false;
+
+        y = 0;
+
+        // the segments span the whole page, so the ones under the rectangle never run out
+        for (size_t i = index, covered = 0; covered < (size_t)rectWidth; i++)
+        {
+            y = std::max(y, segments[i].y);
+
+            if (y + rectHeight > height)
+                return false;
+
+            covered += segments[i].width;
+        }
+
+        return true;
+    }
+
+    // raise the skyline under a rectangle placed on segment index
+    void place(size_t index, int rectWidth, int top)
+    {
+        int right = segments[index].x + rectWidth;
+
+        segments.insert(segments.begin() + index, {segments[index].x, top, rectWidth});
+
+        // drop the segments the rectangle covers and trim the one it ends on
+        size_t next = index + 1;
+
+        while (next < segments.size() && segments[next].x < right)
+        {
+            int end = segments[next].x + segments[next].width;
+
+            if (end > right)
+            {
+                segments[next].x = right;
+                segments[next].width = end - right;
+                break;
+            }
+
+            segments.erase(segments.begin() + next);
+        }
+
+        // neighbours at the same height become one segment
+        for (size_t i = 0; i + 1 < segments.size();)
+        {
+            if (segments[i].y == segments[i + 1].y)
+            {
+                segments[i].width += segments[i + 1].width;
+                segments.erase(segments.begin() + i + 1);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+};
+
+// layout, regions and pixels of an atlas, read from the atlas cache or packed from decoded images
+struct PackedAtlas
+{
+    AtlasLayout layout = AtlasLayout::Layers;
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+
+    std::vector<AtlasRegion> regions;
+
+    // every level's layers back to back, in the mapped cache file or in storage
+    TextureFormat format = TextureFormat::RGBA8;
+    std::vector<AtlasLevel> levels;
+    const unsigned char *pixels = NULL;
+    std::vector<unsigned char> storage;
+    MappedFile file;
+
+    // bytes of one layer of the first level as packed, before any encoding
+    size_t layerSize() const
+    {
+        return (size_t)width * height * 4;
+    }
+
+    // levels a full chain has, packed pages stop at ATLAS_MAX_LEVEL
+    int mipLevels() const
+    {
+        int count = mip_level_count(width, height);
+        return layout == AtlasLayout::Skyline ? std::min(count, ATLAS_MAX_LEVEL + 1) : count;
+    }
+};
+
+// side of the cell a packed image takes, with the padding around it and rounded up to the alignment
+inline int atlas_cell(int size)
+{
+    return (size + 2 * ATLAS_PADDING + ATLAS_ALIGNMENT - 1) / ATLAS_ALIGNMENT * ATLAS_ALIGNMENT;
+}
+
+// lay the images out one per layer when they share a size, otherwise skyline pack them into pages
+//
+// throws std::runtime_error when they need more layers than the device has. images must be no
+// larger than limits.maxSize less the padding on both sides.
+inline void pack_atlas(const std::vector<AtlasImage> &images, const AtlasLimits &limits, PackedAtlas &atlas)
+{
+    bool uniform = !images.empty() && images.size() <= (size_t)limits.maxLayers;
+
+    for (const AtlasImage &image : images)
+        uniform = uniform && image.width == images[0].width && image.height == images[0].height;
+
+    atlas.regions.resize(images.size());
+
+    if (uniform)
+    {
+        atlas.layout = AtlasLayout::Layers;
+        atlas.width = images[0].width;
+        atlas.height = images[0].height;
+        atlas.layers = images.size();
+        atlas.storage.resize(atlas.layerSize() * atlas.layers);
+
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            memcpy(&atlas.storage[i * atlas.layerSize()], images[i].pixels, atlas.layerSize());
+            atlas.regions[i] = {0.0f, 0.0f, 1.0f, 1.0f, (float)i, {}};
+        }
+
+        atlas.format = TextureFormat::RGBA8;
+        atlas.levels.assign(1, {0, atlas.storage.size()});
+        atlas.pixels = atlas.storage.data();
+        return;
+    }
+
+    uint64_t area = 0;
+    int largest = 0;
+
+    for (const AtlasImage &image : images)
+    {
+        area += (uint64_t)atlas_cell(image.width) * atlas_cell(image.height);
+        largest = std::max(largest, std::max(atlas_cell(image.width), atlas_cell(image.height)));
+    }
+
+    // the smallest power of two page holding everything with some slack, bigger sets spill into more layers
+    int limit = std::min(ATLAS_PAGE_SIZE, limits.maxSize);
+    int side = ATLAS_ALIGNMENT;
+
+    while (side < limit && (uint64_t)side * side < area + area / 4)
+        side *= 2;
+
+    side = std::max(std::min(side, limit), largest);
+
+    // tallest first keeps the skyline flat
+    std::vector<size_t> order(images.size());
+
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&images](size_t a, size_t b) {
+        return images[a].height != images[b].height ? images[a].height > images[b].height
+                                                    : images[a].width > images[b].width;
+    });
+
+    std::vector<SkylinePacker> pages;
+    std::vector<int> positions(images.size() * 3);
+
+    for (size_t index : order)
+    {
+        int width = atlas_cell(images[index].width);
+        int height = atlas_cell(images[index].height);
+        int *position = &positions[index * 3];
+        size_t page = 0;
+
+        while (page < pages.size() && !pages[page].insert(width, height, position[0], position[1]))
+            page++;
+
+        if (page == pages.size())
+        {
+            if (pages.size() == (size_t)limits.maxLayers)
+            {
+                throw std::runtime_error("Failed to pack atlas: more than " + std::to_string(limits.maxLayers) +
+                                         " layers");
+            }
+
+            pages.emplace_back();
+            pages.back().create(side, side);
+            pages.back().insert(width, height, position[0], position[1]);
+        }
+
+        position[2] = page;
+    }
+
+    atlas.layout = AtlasLayout::Skyline;
+    atlas.width = side;
+    atlas.height = side;
+    atlas.layers = pages.size();
+    atlas.storage.assign(atlas.layerSize() * atlas.layers, 0);
+
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const AtlasImage &image = images[i];
+        const int *position = &positions[i * 3];
+        size_t rowSize = (size_t)image.width * 4;
+
+        unsigned char *page = &atlas.storage[position[2] * atlas.layerSize()];
+
+        // the padding repeats the edge texels, as clamping would
+        for (int row = 0; row < atlas_cell(image.height); row++)
+        {
+            int sourceRow = std::min(std::max(row - ATLAS_PADDING, 0), image.height - 1);
+            const unsigned char *source = image.pixels + sourceRow * rowSize;
+            unsigned char *destination = page + ((size_t)(position[1] + row) * side + position[0]) * 4;
+
+            for (int column = 0; column < ATLAS_PADDING; column++)
+                memcpy(destination + column * 4, source, 4);
+
+            memcpy(destination + ATLAS_PADDING * 4, source, rowSize);
+
+            for (int column = ATLAS_PADDING + image.width; column < atlas_cell(image.width); column++)
+                memcpy(destination + column * 4, source + rowSize - 4, 4);
+        }
+
+        atlas.regions[i] = {(float)(position[0] + ATLAS_PADDING) / side, (float)(position[1] + ATLAS_PADDING) / side,
+                            (float)image.width / side, (float)image.height / side, (float)position[2], {}};
+    }
+
+    atlas.format = TextureFormat::RGBA8;
+    atlas.levels.assign(1, {0, atlas.storage.size()});
+    atlas.pixels = atlas.storage.data();
+}
+
+// offset and size of every level of a chain, each level's layers back to back and the levels after each other
+inline std::vector<AtlasLevel> atlas_levels(TextureFormat format, int width, int height, int layers, int levelCount)
+{
+    std::vector<AtlasLevel> levels(levelCount);
+    size_t total = 0;
+
+    for (int level = 0; level < levelCount; level++)
+    {
+        size_t layerSize = texture_image_size(format, std::max(width >> level, 1), std::max(height >> level, 1));
+
+        levels[level] = {total, layerSize * layers};
+        total += levels[level].size;
+    }
+
+    return levels;
+}
+
+// build the mip chain on the cpu with mips and store every level of every layer in format
+//
+// a layer per image is filtered as one image. packed pages are filtered one cell at a time, so
+// the wide filters see an image's padding repeat at its edges and never its neighbours; cells
+// stay whole texels down to ATLAS_MAX_LEVEL. cells and block rows are spread over the builder's
+// pool. the RGBA8 first level is replaced by the whole chain in format.
+inline void encode_atlas(PackedAtlas &atlas, TextureFormat format, const MipBuilder &mips)
+{
+    int levelCount = atlas.mipLevels();
+    std::vector<AtlasLevel> levels = atlas_levels(TextureFormat::RGBA8, atlas.width, atlas.height, atlas.layers,
+                                                  levelCount);
+    std::vector<unsigned char> chain(levels.back().offset + levels.back().size);
+
+    memcpy(chain.data(), atlas.pixels, levels[0].size);
+
+    // layer of a level in the chain
+    auto layerPixels = [&](int level, int layer) {
+        int width = std::max(atlas.width >> level, 1);
+        int height = std::max(atlas.height >> level, 1);
+
+        return &chain[levels[level].offset + (size_t)layer * width * height * 4];
+    };
+
+    if (atlas.layout == AtlasLayout::Layers)
+    {
+        MipBuilder builder = mips;
+
+        for (int layer = 0; layer < atlas.layers; layer++)
+        {
+            builder.build(layerPixels(0, layer), atlas.width, atlas.height, levelCount,
+                          [&](int level, const unsigned char *pixels, int width, int height) {
+                              if (level > 0)
+                                  memcpy(layerPixels(level, layer), pixels, (size_t)width * height * 4);
+                          });
+        }
+    }
+    else
+    {
+        parallel_for(mips.pool, atlas.regions.size(), ATLAS_CELLS_PER_JOB, [&](size_t begin, size_t end) {
+            // the cells of one job are built on its own thread
+            MipBuilder builder = mips;
+            builder.pool = NULL;
+
+            std::vector<unsigned char> cell;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                const AtlasRegion &region = atlas.regions[i];
+                int x = (int)lroundf(region.u * atlas.width) - ATLAS_PADDING;
+                int y = (int)lroundf(region.v * atlas.height) - ATLAS_PADDING;
+                int width = atlas_cell((int)lroundf(region.width * atlas.width));
+                int height = atlas_cell((int)lroundf(region.height * atlas.height));
+                int layer = (int)region.layer;
+
+                cell.resize((size_t)width * height * 4);
+
+                for (int row = 0; row < height; row++)
+                {
+                    const unsigned char *source = layerPixels(0, layer) + ((size_t)(y + row) * atlas.width + x) * 4;
+                    memcpy(&cell[(size_t)row * width * 4], source, (size_t)width * 4);
+                }
+
+                builder.build(cell.data(), width, height, levelCount,
+                              [&](int level, const unsigned char *pixels, int levelWidth, int levelHeight) {
+                                  int pageWidth = std::max(atlas.width >> level, 1);
+                                  unsigned char *page = layerPixels(level, layer);
+
+                                  for (int row = 0; level > 0 && row < levelHeight; row++)
+                                  {
+                                      memcpy(page + ((size_t)((y >> level) + row) * pageWidth + (x >> level)) * 4,
+                                             pixels + (size_t)row * levelWidth * 4, (size_t)levelWidth * 4);
+                                  }
+                              });
+            }
+        });
+    }
+
+    if (format != TextureFormat::RGBA8)
+    {
+        std::vector<AtlasLevel> encodedLevels = atlas_levels(format, atlas.width, atlas.height, atlas.layers,
+                                                             levelCount);
+        std::vector<unsigned char> encoded(encodedLevels.back().offset + encodedLevels.back().size);
+
+        for (int level = 0; level < levelCount; level++)
+        {
+            int width = std::max(atlas.width >> level, 1);
+            int height = std::max(atlas.height >> level, 1);
+            size_t imageSize = texture_image_size(format, width, height);
+            size_t rowSize = texture_image_size(format, width, 1);
+
+            for (int layer = 0; layer < atlas.layers; layer++)
+            {
+                const unsigned char *pixels = layerPixels(level, layer);
+                unsigned char *output = &encoded[encodedLevels[level].offset + layer * imageSize];
+
+                parallel_for(mips.pool, (height + 3) / 4, ATLAS_BLOCK_ROWS_PER_JOB, [&](size_t begin, size_t end) {
+                    compress_block_rows(format, pixels, width, height, begin, end, output + begin * rowSize);
+                });
+            }
+        }
+
+        levels.swap(encodedLevels);
+        chain.swap(encoded);
+    }
+
+    atlas.format = format;
+    atlas.levels = levels;
+    atlas.storage.swap(chain);
+    atlas.pixels = atlas.storage.data();
+}
+
+// the sources are identified by path, size and modification time rather than hashing their contents
+inline uint64_t atlas_cache_key(const std::vector<std::string> &paths, const AtlasLimits &limits, bool compress,
+                                const MipBuilder &mips)
+{
+    int64_t settings[8] = {limits.maxSize, limits.maxLayers, ATLAS_PAGE_SIZE, ATLAS_PADDING, ATLAS_CACHE_VERSION,
+                           compress, (int64_t)mips.filter, mips.srgb};
+    uint64_t key = hash_bytes(settings, sizeof(settings));
+
+    // a missing file still gets a key, it changes once the file shows up
+    for (const std::string &path : paths)
+        hash_file_identity(path, key);
+
+    return key;
+}
+
+inline std::string atlas_cache_path(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.atlas", (unsigned long long)key);
+
+    return ATLAS_CACHE_DIRECTORY + std::string(name);
+}
+
+// returns false when there is no usable cache file, the pixels stay in the mapping
+inline bool load_atlas_cache(uint64_t key, PackedAtlas &atlas)
+{
+    try
+    {
+        atlas.file = MappedFile(atlas_cache_path(key));
+    }
+    catch (std::runtime_error &)
+    {
+        return false;
+    }
+
+    const char *data = atlas.file.data();
+    size_t size = atlas.file.size();
+
+    AtlasCacheHeader header;
+
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != ATLAS_CACHE_MAGIC || header.version != ATLAS_CACHE_VERSION || header.key != key ||
+        header.layout > (uint32_t)AtlasLayout::Skyline || header.format > (uint32_t)TextureFormat::BC3 ||
+        header.levelCount == 0 || header.levelCount > ATLAS_CACHE_MAX_LEVELS)
+        return false;
+
+    size_t regionBytes = (size_t)header.regionCount * sizeof(AtlasRegion);
+
+    if (header.regionOffset > size || regionBytes > size - header.regionOffset || header.pixelOffset > size)
+        return false;
+
+    for (uint32_t level = 0; level < header.levelCount; level++)
+    {
+        const AtlasLevel &entry = header.levels[level];
+        size_t expected = texture_image_size((TextureFormat)header.format, std::max(header.width >> level, 1u),
+                                             std::max(header.height >> level, 1u)) * header.layers;
+
+        if (entry.size != expected || entry.offset > size - header.pixelOffset ||
+            entry.size > size - header.pixelOffset - entry.offset)
+            return false;
+    }
+
+    atlas.layout = (AtlasLayout)header.layout;
+    atlas.format = (TextureFormat)header.format;
+    atlas.width = header.width;
+    atlas.height = header.height;
+    atlas.layers = header.layers;
+    atlas.levels.assign(header.levels, header.levels + header.levelCount);
+    atlas.regions.resize(header.regionCount);
+    memcpy(atlas.regions.data(), data + header.regionOffset, regionBytes);
+    atlas.pixels = (const unsigned char *)data + header.pixelOffset;
+
+    return true;
+}
+
+inline void save_atlas_cache(uint64_t key, const PackedAtlas &atlas)
+{
+    if (!make_directories(ATLAS_CACHE_DIRECTORY) || atlas.levels.size() > ATLAS_CACHE_MAX_LEVELS)
+        return;
+
+    AtlasCacheHeader header = {};
+    header.magic = ATLAS_CACHE_MAGIC;
+    header.version = ATLAS_CACHE_VERSION;
+    header.key = key;
+    header.layout = (uint32_t)atlas.layout;
+    header.format = (uint32_t)atlas.format;
+    header.width = atlas.width;
+    header.height = atlas.height;
+    header.layers = atlas.layers;
+    header.levelCount = atlas.levels.size();
+    header.regionCount = atlas.regions.size();
+
+    size_t pixelBytes = 0;
+
+    for (size_t level = 0; level < atlas.levels.size(); level++)
+    {
+        header.levels[level] = atlas.levels[level];
+        pixelBytes = std::max(pixelBytes, (size_t)(atlas.levels[level].offset + atlas.levels[level].size));
+    }
+
+    // keep both blocks 16 byte aligned in the mapping
+    size_t regionBytes = atlas.regions.size() * sizeof(AtlasRegion);
+    header.regionOffset = cache_block_offset(sizeof(header));
+    header.pixelOffset = cache_block_offset(header.regionOffset + regionBytes);
+
+    write_cache_file(atlas_cache_path(key), {{0, &header, sizeof(header)},
+                                             {header.regionOffset, atlas.regions.data(), regionBytes},
+                                             {header.pixelOffset, atlas.pixels, pixelBytes}});
+}
+
+// an array texture holding many images, and the buffer texture of regions to find them by index
+//
+// objects drawing different images of one atlas share its texture binding, so they still sort
+// into one batch. the vertex shader fetches its image's region and remaps the texture coordinates.
+class TextureAtlas
+{
+  public:
+    unsigned int texture = 0;
+    unsigned int regionBuffer = 0;
+    unsigned int regionTexture = 0;
+    unsigned int imageCount = 0;
+
+    // what upload() stored, for reports
+    TextureFormat format = TextureFormat::RGBA8;
+    int width = 1;
+    int height = 1;
+    int layers = 1;
+    int levels = 1;
+    size_t bytes = 4;
+
+    // every image shows a white placeholder until upload()
+    void create(unsigned int count)
+    {
+        imageCount = count;
+
+        glGenTextures(1, &texture);
+        gl_state().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        const unsigned char white[4] = {255, 255, 255, 255};
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+
+        std::vector<AtlasRegion> placeholders(count > 0 ? count : 1, {0.0f, 0.0f, 1.0f, 1.0f, 0.0f, {}});
+
+        glGenBuffers(1, &regionBuffer);
+        gl_state().bindBuffer(GL_TEXTURE_BUFFER, regionBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, placeholders.size() * sizeof(AtlasRegion), placeholders.data(),
+                     GL_STATIC_DRAW);
+
+        glGenTextures(1, &regionTexture);
+        gl_state().bindTexture(GL_TEXTURE_BUFFER, regionTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, regionBuffer);
+    }
+
+    // replace the placeholder with the packed layers and their mip chain
+    //
+    // RGBA8 levels stream through the pixel buffer pool, compressed ones go straight to
+    // glCompressedTexImage3D. either way the levels come from the cpu, the driver builds none.
+    void upload(const PackedAtlas &atlas, PixelUploadPool &uploads)
+    {
+        bool packed = atlas.layout == AtlasLayout::Skyline;
+
+        format = atlas.format;
+        width = atlas.width;
+        height = atlas.height;
+        layers = atlas.layers;
+        levels = atlas.levels.size();
+        bytes = 0;
+
+        gl_state().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+        for (int level = 0; level < levels; level++)
+        {
+            const AtlasLevel &entry = atlas.levels[level];
+            int levelWidth = std::max(width >> level, 1);
+            int levelHeight = std::max(height >> level, 1);
+
+            if (atlas.format == TextureFormat::RGBA8)
+            {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, layers, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, NULL);
+            }
+            else
+            {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, texture_internal_format(atlas.format), levelWidth,
+                                       levelHeight, layers, 0, entry.size, atlas.pixels + entry.offset);
+            }
+
+            bytes += entry.size;
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        if (atlas.format == TextureFormat::RGBA8)
+        {
+            for (int level = 0; level < levels; level++)
+            {
+                int levelWidth = std::max(width >> level, 1);
+                int levelHeight = std::max(height >> level, 1);
+                size_t layerSize = (size_t)levelWidth * levelHeight * 4;
+
+                for (int layer = 0; layer < layers; layer++)
+                {
+                    uploads.uploadLayer(texture, level, layer, 0, 0, levelWidth, levelHeight,
+                                        atlas.pixels + atlas.levels[level].offset + layer * layerSize);
+                }
+            }
+
+            gl_state().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        }
+
+        // a layer per image can repeat like a texture of its own, packed images end at their padding
+        GLenum wrap = packed ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT;
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+
+        gl_state().bindBuffer(GL_TEXTURE_BUFFER, regionBuffer);
+        size_t regionCount = std::min(atlas.regions.size(), (size_t)imageCount);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, regionCount * sizeof(AtlasRegion), atlas.regions.data());
+    }
+
+    // one line of size, format and memory use
+    void report(FILE *file) const
+    {
+        fprintf(file, "atlas %d x %d x %d, %s, %d levels, %.1f kb\n", width, height, layers,
+                texture_format_name(format), levels, bytes / 1024.0);
+    }
+
+    void destroy()
+    {
+        unsigned int textures[2] = {texture, regionTexture};
+
+        gl_state().deleteTextures(2, textures);
+        gl_state().deleteBuffers(1, &regionBuffer);
+
+        texture = regionTexture = regionBuffer = 0;
+    }
+};
+
+#endif
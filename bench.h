@@ -0,0 +1,254 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "libs/glad.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "profiler.h"
+
+// frames rendered before measuring so shader compilation and first uploads don't skew results
+const unsigned int BENCH_WARMUP_FRAMES = 30;
+
+// gpu timer queries are read back this many frames later to avoid stalling on results
+const unsigned int BENCH_QUERY_LATENCY = 4;
+
+// one point of a scripted camera path
+struct CameraKey
+{
+    float time;
+    glm::vec3 position;
+    float yaw, pitch;
+};
+
+// deterministic camera flight, sampled with linear interpolation and looped over its duration
+class CameraPath
+{
+  public:
+    std::vector<CameraKey> keys;
+
+    // fly in front of the hand placed cubes, then sweep across the generated field behind them
+    static CameraPath flythrough()
+    {
+        CameraPath path;
+
+        path.keys = {
+            {0.0f, glm::vec3(0.0f, 0.0f, 3.0f), -90.0f, 0.0f},
+            {2.0f, glm::vec3(3.0f, 1.0f, 1.0f), -110.0f, -10.0f},
+            {4.0f, glm::vec3(0.0f, 4.0f, -6.0f), -90.0f, -35.0f},
+            {6.0f, glm::vec3(-6.0f, 0.0f, -12.0f), -30.0f, 5.0f},
+            {8.0f, glm::vec3(0.0f, 0.0f, -18.0f), 90.0f, 0.0f},
+            {10.0f, glm::vec3(0.0f, 0.0f, 3.0f), 270.0f, 0.0f},
+        };
+
+        return path;
+    }
+
+    void sample(float time, glm::vec3 &position, float &yaw, float &pitch) const
+    {
+        float duration = keys.back().time;
+        float t = fmodf(time, duration);
+
+        size_t next = 1;
+
+        while (next < keys.size() - 1 && keys[next].time < t)
+            next++;
+
+        const CameraKey &a = keys[next - 1];
+        const CameraKey &b = keys[next];
+        float blend = (t - a.time) / (b.time - a.time);
+
+        position = a.position + (b.position - a.position) * blend;
+        yaw = a.yaw + (b.yaw - a.yaw) * blend;
+        pitch = a.pitch + (b.pitch - a.pitch) * blend;
+    }
+};
+
+// min/avg/percentiles of a set of samples in milliseconds
+struct BenchSummary
+{
+    double min, avg, p50, p95, p99, max;
+};
+
+// records cpu, gpu and whole frame times and writes a machine readable report
+class Bench
+{
+  public:
+    void create()
+    {
+        glGenQueries(BENCH_QUERY_LATENCY, queries);
+
+        for (unsigned int i = 0; i < BENCH_QUERY_LATENCY; i++)
+            queryFrames[i] = -1;
+    }
+
+    void beginFrame(unsigned int frame)
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        // the interval that just ended belongs to the previous frame
+        if (frame > 0 && measured(currentFrame))
+            frameTimes.push_back(milliseconds(frameStart, now));
+
+        frameStart = now;
+        currentFrame = frame;
+
+        // state call counts cover the measured frames only
+        if (frame == BENCH_WARMUP_FRAMES)
+            gl_state().resetCounters();
+
+        // the slot about to be reused holds the query from BENCH_QUERY_LATENCY frames ago
+        unsigned int slot = frame % BENCH_QUERY_LATENCY;
+        collect(slot);
+
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+        queryFrames[slot] = frame;
+    }
+
+    // end of cpu work for the frame, before presenting
+    void endFrame()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+
+        if (measured(currentFrame))
+            cpuTimes.push_back(milliseconds(frameStart, std::chrono::steady_clock::now()));
+    }
+
+    // wait for outstanding queries and write the report, including the profiler's scopes when enabled
+    void finish(const char *path, const char *label, Profiler &profiler)
+    {
+        // the last frame has presented but no frame began after it
+        if (measured(currentFrame))
+            frameTimes.push_back(milliseconds(frameStart, std::chrono::steady_clock::now()));
+
+        for (unsigned int i = 0; i < BENCH_QUERY_LATENCY; i++)
+            collect(i);
+
+        BenchSummary frame = summarize(frameTimes);
+        BenchSummary cpu = summarize(cpuTimes);
+        BenchSummary gpu = summarize(gpuTimes);
+
+        printf("bench %s: %u frames\n", label, (unsigned int)cpuTimes.size());
+        printf("  frame ms  min %.3f avg %.3f p50 %.3f p95 %.3f p99 %.3f\n", frame.min, frame.avg, frame.p50, frame.p95,
+               frame.p99);
+        printf("  cpu ms    min %.3f avg %.3f p50 %.3f p95 %.3f p99 %.3f\n", cpu.min, cpu.avg, cpu.p50, cpu.p95,
+               cpu.p99);
+        printf("  gpu ms    min %.3f avg %.3f p50 %.3f p95 %.3f p99 %.3f\n", gpu.min, gpu.avg, gpu.p50, gpu.p95,
+               gpu.p99);
+
+        if (profiler.enabled)
+            profiler.report(stdout);
+
+        FILE *file = fopen(path, "w");
+
+        if (file == NULL)
+        {
+            printf("Failed to write bench report %s\n", path);
+            return;
+        }
+
+        fprintf(file, "{\n  \"label\": \"%s\",\n  \"frames\": %u,\n", label, (unsigned int)cpuTimes.size());
+        writeSummary(file, "frame_ms", frame, false);
+        writeSummary(file, "cpu_ms", cpu, false);
+        writeSummary(file, "gpu_ms", gpu, false);
+
+        fprintf(file, "  \"state_calls\": {\n");
+        gl_state().writeJson(file);
+        fprintf(file, "  }%s\n", profiler.enabled ? "," : "");
+
+        if (profiler.enabled)
+        {
+            fprintf(file, "  \"scopes\": {\n");
+            profiler.writeJson(file);
+            fprintf(file, "  }\n");
+        }
+
+        fprintf(file, "}\n");
+
+        fclose(file);
+
+        glDeleteQueries(BENCH_QUERY_LATENCY, queries);
+    }
+
+  private:
+    unsigned int queries[BENCH_QUERY_LATENCY];
+    int queryFrames[BENCH_QUERY_LATENCY];
+
+    unsigned int currentFrame = 0;
+    std::chrono::steady_clock::time_point frameStart;
+
+    std::vector<double> frameTimes;
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+
+    void collect(unsigned int slot)
+    {
+        if (queryFrames[slot] < 0)
+            return;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+
+        if (measured(queryFrames[slot]))
+            gpuTimes.push_back(elapsed / 1000000.0);
+
+        queryFrames[slot] = -1;
+    }
+
+    // one warmup test for every series, so they all cover the same frames
+    static bool measured(unsigned int frame)
+    {
+        return frame >= BENCH_WARMUP_FRAMES;
+    }
+
+    static double milliseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    static BenchSummary summarize(std::vector<double> samples)
+    {
+        BenchSummary summary = {};
+
+        if (samples.empty())
+            return summary;
+
+        std::sort(samples.begin(), samples.end());
+
+        double total = 0.0;
+
+        for (double sample : samples)
+            total += sample;
+
+        summary.min = samples.front();
+        summary.max = samples.back();
+        summary.avg = total / samples.size();
+        summary.p50 = percentile(samples, 0.50);
+        summary.p95 = percentile(samples, 0.95);
+        summary.p99 = percentile(samples, 0.99);
+
+        return summary;
+    }
+
+    // nearest rank percentile of sorted samples
+    static double percentile(const std::vector<double> &sorted, double fraction)
+    {
+        size_t rank = (size_t)ceil(fraction * sorted.size());
+
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+
+    static void writeSummary(FILE *file, const char *name, const BenchSummary &summary, bool last)
+    {
+        fprintf(file,
+                "  \"%s\": {\"min\": %.4f, \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+                name, summary.min, summary.avg, summary.p50, summary.p95, summary.p99, summary.max, last ? "" : ",");
+    }
+};
+
+#endif
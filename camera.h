@@ -1,15 +1,24 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 
+#include "framedata.h"
 #include "util.h"
 
 const float DEFAULT_SPEED = 3.50f;
 
+// axis aligned box given by its center and half size
+struct BoundingBox
+{
+    glm::vec3 center;
+    glm::vec3 extents;
+};
+
 class Camera
 {
   public:
@@ -22,6 +31,8 @@ class Camera
         view = glm::lookAt(pos, pos + front, up);
         projection = proj;
 
+        updateFrustum();
+
         speed = DEFAULT_SPEED;
 
         sensitivity = 1.0f;
@@ -30,6 +41,9 @@ class Camera
     glm::mat4 view;
     glm::mat4 projection;
 
+    // left, right, bottom, top, near, far planes as (normal, distance), normals point inwards
+    glm::vec4 frustum[6];
+
     glm::vec3 position;
 
     glm::vec3 front, up, right;
@@ -43,6 +57,97 @@ class Camera
     void updateView()
     {
         view = glm::lookAt(position, position + front, up);
+
+        updateFrustum();
+    }
+
+    // extract the six clip planes from projection * view (Gribb & Hartmann)
+    void updateFrustum()
+    {
+        glm::mat4 m = projection * view;
+
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 row = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+            glm::vec4 w = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+            frustum[i * 2] = w + row;
+            frustum[i * 2 + 1] = w - row;
+        }
+
+        for (int i = 0; i < 6; i++)
+            frustum[i] /= glm::length(glm::vec3(frustum[i]));
+    }
+
+    // test spheres packed as (center, radius), writes the indices of the visible ones and returns their count
+    size_t cullSpheres(const glm::vec4 *spheres, size_t count, unsigned int *visible) const
+    {
+        size_t visibleCount = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const glm::vec4 &sphere = spheres[i];
+            bool inside = true;
+
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                const glm::vec4 &plane = frustum[p];
+                inside = plane.x * sphere.x + plane.y * sphere.y + plane.z * sphere.z + plane.w > -sphere.w;
+            }
+
+            visible[visibleCount] = (unsigned int)i;
+            visibleCount += inside;
+        }
+
+        return visibleCount;
+    }
+
+    // same as cullSpheres for boxes, each plane is tested against the box corner furthest along its normal
+    size_t cullBoxes(const BoundingBox *boxes, size_t count, unsigned int *visible) const
+    {
+        size_t visibleCount = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const BoundingBox &box = boxes[i];
+            bool inside = true;
+
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                const glm::vec4 &plane = frustum[p];
+
+                float distance = plane.x * box.center.x + plane.y * box.center.y + plane.z * box.center.z + plane.w;
+                float radius = fabsf(plane.x) * box.extents.x + fabsf(plane.y) * box.extents.y +
+                               fabsf(plane.z) * box.extents.z;
+
+                inside = distance > -radius;
+            }
+
+            visible[visibleCount] = (unsigned int)i;
+            visibleCount += inside;
+        }
+
+        return visibleCount;
+    }
+
+    void fillFrameData(FrameData &data) const
+    {
+        data.view = view;
+        data.projection = projection;
+        data.viewProjection = projection * view;
+    }
+
+    // point the camera from yaw and pitch in degrees
+    void setRotation(float newYaw, float newPitch)
+    {
+        yaw = newYaw;
+        pitch = newPitch;
+
+        glm::vec3 direction;
+        direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+        direction.y = sin(glm::radians(pitch));
+        direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+        front = glm::normalize(direction);
     }
 
     void setSpeed(float newValue)
@@ -69,11 +174,7 @@ class Camera
 		if(pitch < -89.0f)
 			pitch = -89.0f;
 
-        glm::vec3 direction;
-        direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-        direction.y = sin(glm::radians(pitch));
-        direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-        front = glm::normalize(direction);
+        setRotation(yaw, pitch);
 
         updateView();
     }
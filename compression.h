@@ -0,0 +1,365 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "libs/glad.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// from EXT_texture_compression_s3tc, which the generated loader leaves out
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// power iterations spent finding a block's principal color axis
+const int BLOCK_AXIS_ITERATIONS = 8;
+
+// how texture data is stored, on disk and on the gpu
+enum class TextureFormat : uint32_t
+{
+    RGBA8,
+    // 4x4 blocks of two 565 endpoints and 2 bit indices, 8 bytes, opaque
+    BC1,
+    // a BC1 color block after a block of two alpha endpoints and 3 bit indices, 16 bytes
+    BC3
+};
+
+inline const char *texture_format_name(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::RGBA8:
+        return "rgba8";
+    case TextureFormat::BC1:
+        return "bc1";
+    case TextureFormat::BC3:
+        return "bc3";
+    }
+
+    return "unknown";
+}
+
+inline GLenum texture_internal_format(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureFormat::BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:
+        return GL_RGBA8;
+    }
+}
+
+// bytes of one width x height image, partial blocks at the edges count whole
+inline size_t texture_image_size(TextureFormat format, int width, int height)
+{
+    if (format == TextureFormat::RGBA8)
+        return (size_t)width * height * 4;
+
+    size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+    return blocks * (format == TextureFormat::BC1 ? 8 : 16);
+}
+
+// BC3 when any pixel is translucent, BC1 otherwise
+inline TextureFormat choose_block_format(const unsigned char *pixels, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (pixels[i * 4 + 3] != 255)
+            return TextureFormat::BC3;
+    }
+
+    return TextureFormat::BC1;
+}
+
+inline uint16_t pack_565(const float color[3])
+{
+    int r = (int)(fminf(fmaxf(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(fminf(fmaxf(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(fminf(fmaxf(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+
+    return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+// the 8 bit color a decoder expands an endpoint to
+inline void unpack_565(uint16_t value, int color[3])
+{
+    int r = (value >> 11) & 31;
+    int g = (value >> 5) & 63;
+    int b = value & 31;
+
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+// squared error of a block against the palette of two endpoints, and the index of each pixel's closest entry
+//
+// the endpoints are put in decreasing order first, which selects the four color mode
+inline uint32_t bc1_fit(const unsigned char block[64], uint16_t &color0, uint16_t &color1, uint32_t &indices)
+{
+    if (color0 < color1)
+    {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+
+    int palette[4][3];
+    unpack_565(color0, palette[0]);
+    unpack_565(color1, palette[1]);
+
+    for (int channel = 0; channel < 3; channel++)
+    {
+        palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+        palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+    }
+
+    // equal endpoints leave three color mode on, but index 0 is right for every pixel then
+    int entries = color0 == color1 ? 1 : 4;
+
+    uint32_t error = 0;
+    indices = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        const unsigned char *pixel = &block[i * 4];
+        int closest = 0;
+        int closestError = 0x7fffffff;
+
+        for (int entry = 0; entry < entries; entry++)
+        {
+            int dr = pixel[0] - palette[entry][0];
+            int dg = pixel[1] - palette[entry][1];
+            int db = pixel[2] - palette[entry][2];
+            int distance = dr * dr + dg * dg + db * db;
+
+            if (distance < closestError)
+            {
+                closest = entry;
+                closestError = distance;
+            }
+        }
+
+        indices |= (uint32_t)closest << (i * 2);
+        error += closestError;
+    }
+
+    return error;
+}
+
+// endpoints from the extremes of the block along its principal axis, then refined once by least squares
+inline void encode_bc1_color(const unsigned char block[64], unsigned char output[8])
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+            mean[channel] += block[i * 4 + channel] / 16.0f;
+    }
+
+    // covariance xx, xy, xz, yy, yz, zz
+    float covariance[6] = {};
+
+    for (int i = 0; i < 16; i++)
+    {
+        float r = block[i * 4] - mean[0];
+        float g = block[i * 4 + 1] - mean[1];
+        float b = block[i * 4 + 2] - mean[2];
+
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+
+    for (int iteration = 0; iteration < BLOCK_AXIS_ITERATIONS; iteration++)
+    {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float length = sqrtf(x * x + y * y + z * z);
+
+        // a flat block has no axis, its endpoints both land on the mean
+        if (length == 0.0f)
+            break;
+
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    float lowest = 0.0f;
+    float highest = 0.0f;
+
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] +
+                  (block[i * 4 + 2] - mean[2]) * axis[2];
+
+        lowest = fminf(lowest, t);
+        highest = fmaxf(highest, t);
+    }
+
+    // pull the endpoints in a little, the extremes are usually single outliers
+    float inset = (highest - lowest) / 16.0f;
+    float end0[3], end1[3];
+
+    for (int channel = 0; channel < 3; channel++)
+    {
+        end0[channel] = mean[channel] + axis[channel] * (highest - inset);
+        end1[channel] = mean[channel] + axis[channel] * (lowest + inset);
+    }
+
+    uint16_t color0 = pack_565(end0);
+    uint16_t color1 = pack_565(end1);
+    uint32_t indices;
+    uint32_t error = bc1_fit(block, color0, color1, indices);
+
+    // solve for the endpoints that best reproduce the block with the chosen indices
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ap[3] = {}, bp[3] = {};
+
+    for (int i = 0; i < 16; i++)
+    {
+        float a = weights[(indices >> (i * 2)) & 3];
+        float b = 1.0f - a;
+
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for (int channel = 0; channel < 3; channel++)
+        {
+            ap[channel] += a * block[i * 4 + channel];
+            bp[channel] += b * block[i * 4 + channel];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+
+    if (fabsf(determinant) > 1e-6f)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            end0[channel] = (bb * ap[channel] - ab * bp[channel]) / determinant;
+            end1[channel] = (aa * bp[channel] - ab * ap[channel]) / determinant;
+        }
+
+        uint16_t refined0 = pack_565(end0);
+        uint16_t refined1 = pack_565(end1);
+        uint32_t refinedIndices;
+
+        if (bc1_fit(block, refined0, refined1, refinedIndices) < error)
+        {
+            color0 = refined0;
+            color1 = refined1;
+            indices = refinedIndices;
+        }
+    }
+
+    output[0] = color0 & 0xff;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xff;
+    output[3] = color1 >> 8;
+
+    for (int i = 0; i < 4; i++)
+        output[4 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+// alpha endpoints at the block's extremes, eight interpolated values between them
+inline void encode_bc3_alpha(const unsigned char block[64], unsigned char output[8])
+{
+    int lowest = 255;
+    int highest = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        lowest = block[i * 4 + 3] < lowest ? block[i * 4 + 3] : lowest;
+        highest = block[i * 4 + 3] > highest ? block[i * 4 + 3] : highest;
+    }
+
+    memset(output, 0, 8);
+    output[0] = highest;
+    output[1] = lowest;
+
+    // equal endpoints decode index 0 as the one alpha value
+    if (highest == lowest)
+        return;
+
+    int palette[8] = {highest, lowest};
+
+    for (int entry = 2; entry < 8; entry++)
+        palette[entry] = ((8 - entry) * highest + (entry - 1) * lowest) / 7;
+
+    uint64_t indices = 0;
+
+    for (int i = 0; i < 16; i++)
+    {
+        int alpha = block[i * 4 + 3];
+        int closest = 0;
+
+        for (int entry = 1; entry < 8; entry++)
+        {
+            if (abs(alpha - palette[entry]) < abs(alpha - palette[closest]))
+                closest = entry;
+        }
+
+        indices |= (uint64_t)closest << (i * 3);
+    }
+
+    for (int i = 0; i < 6; i++)
+        output[2 + i] = (indices >> (i * 8)) & 0xff;
+}
+
+// block compress rows [firstRow, lastRow) of 4x4 blocks of an RGBA8 image, output points at the first of them
+//
+// blocks hanging over the right or top edge repeat the last column or row. ranges of rows are
+// independent, so an image can be split over threads.
+inline void compress_block_rows(TextureFormat format, const unsigned char *pixels, int width, int height,
+                                int firstRow, int lastRow, unsigned char *output)
+{
+    unsigned char block[64];
+
+    for (int blockY = firstRow * 4; blockY < lastRow * 4 && blockY < height; blockY += 4)
+    {
+        for (int blockX = 0; blockX < width; blockX += 4)
+        {
+            for (int y = 0; y < 4; y++)
+            {
+                int row = blockY + y < height ? blockY + y : height - 1;
+
+                for (int x = 0; x < 4; x++)
+                {
+                    int column = blockX + x < width ? blockX + x : width - 1;
+                    memcpy(&block[(y * 4 + x) * 4], &pixels[((size_t)row * width + column) * 4], 4);
+                }
+            }
+
+            if (format == TextureFormat::BC3)
+            {
+                encode_bc3_alpha(block, output);
+                output += 8;
+            }
+
+            encode_bc1_color(block, output);
+            output += 8;
+        }
+    }
+}
+
+#endif
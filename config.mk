@@ -1,4 +1,10 @@
-LIBS = -lglfw -lstdc++ -lGL -lX11 -lpthread -lXrandr -lXi -ldl
+LIBS = -lglfw -lstdc++ -lGL -lEGL -lX11 -lpthread -lXrandr -lXi -ldl
 LDFLAGS = ${LIBS}
 
+# add -DARENA_DEBUG to poison frame arena and ring buffer memory when it is handed out and released
+CXXFLAGS = -O2
+
+# arguments for the bench target, e.g. make bench BENCH_ARGS="--per-draw --cubes 100000"
+BENCH_ARGS = --cubes 10000 --bench-out bench.json
+
 CC = g++
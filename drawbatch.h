@@ -0,0 +1,131 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include "libs/glad.h"
+#include <cstdint>
+#include <functional>
+
+#include "arena.h"
+#include "mesh.h"
+#include "renderqueue.h"
+#include "util.h"
+
+// one draw as glMultiDrawElementsIndirect reads it from the indirect buffer
+struct DrawElementsIndirectCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// consecutive commands sharing program and texture, issued with a single call when multi-draw is available
+//
+// program and texture are the RenderStateIds ids from the sort key, resolve them to gl names to bind.
+struct DrawGroup
+{
+    unsigned int program;
+    unsigned int texture;
+    unsigned int firstCommand;
+    unsigned int commandCount;
+};
+
+// merges the sorted draws of a RenderQueue into indirect commands
+//
+// every mesh must come from the same MeshPool so one VAO serves the whole batch. neighbouring
+// draws of the same mesh and state become one instanced command, and commands between state
+// changes form a group. instances lists the caller's instance ids in the order the commands
+// consume them, so their per-instance data is written in that order and each command's
+// baseInstance indexes into it. the arrays live in the arena given to build().
+class DrawBatch
+{
+  public:
+    DrawElementsIndirectCommand *commands = NULL;
+    DrawGroup *groups = NULL;
+    uint32_t *instances = NULL;
+
+    size_t commandCount = 0;
+    size_t groupCount = 0;
+    size_t instanceCount = 0;
+
+    // whether glMultiDrawElementsIndirect with base instances can be used
+    bool multiDraw = false;
+
+    void create()
+    {
+        bool supported = GLAD_GL_VERSION_4_3 ||
+                         (has_extension("GL_ARB_multi_draw_indirect") && has_extension("GL_ARB_base_instance"));
+
+        // glad only loads entry points for the core version it found
+        multiDraw = supported && glMultiDrawElementsIndirect != NULL;
+    }
+
+    void build(const RenderQueue &queue, Arena &arena)
+    {
+        const RenderItem *items = queue.begin();
+
+        // every draw could need its own command and group
+        commands = arena.allocate<DrawElementsIndirectCommand>(queue.size());
+        groups = arena.allocate<DrawGroup>(queue.size());
+        instances = arena.allocate<uint32_t>(queue.size());
+
+        commandCount = 0;
+        groupCount = 0;
+        instanceCount = queue.size();
+
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            const RenderItem &item = items[i];
+            instances[i] = item.instance;
+
+            if (i > 0 && RenderQueue::batchKey(item.key) == RenderQueue::batchKey(items[i - 1].key))
+            {
+                commands[commandCount - 1].instanceCount++;
+                continue;
+            }
+
+            unsigned int program = RenderQueue::program(item.key);
+            unsigned int texture = RenderQueue::texture(item.key);
+
+            if (groupCount == 0 || groups[groupCount - 1].program != program ||
+                groups[groupCount - 1].texture != texture)
+                groups[groupCount++] = {program, texture, (unsigned int)commandCount, 0};
+
+            commands[commandCount++] = {item.mesh->indexCount, 1, item.mesh->firstIndex, item.mesh->baseVertex,
+                                        (uint32_t)i};
+            groups[groupCount - 1].commandCount++;
+        }
+    }
+
+    // issue a group with the pool VAO, its program and texture bound, returns the number of draw calls
+    //
+    // indirect draws read the commands from commandOffset in the bound GL_DRAW_INDIRECT_BUFFER. without
+    // multi-draw every command is drawn on its own, after setInstanceBase points the per-instance
+    // attributes at its first instance since GL 3.3 has no base instance.
+    unsigned int draw(const DrawGroup &group, bool indirect, size_t commandOffset,
+                      const std::function<void(uint32_t)> &setInstanceBase) const
+    {
+        if (indirect && multiDraw)
+        {
+            size_t offset = commandOffset + group.firstCommand * sizeof(DrawElementsIndirectCommand);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)offset, group.commandCount, 0);
+
+            return 1;
+        }
+
+        for (unsigned int i = 0; i < group.commandCount; i++)
+        {
+            const DrawElementsIndirectCommand &command = commands[group.firstCommand + i];
+            setInstanceBase(command.baseInstance);
+
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                              (void *)(command.firstIndex * sizeof(uint32_t)), command.instanceCount,
+                                              command.baseVertex);
+        }
+
+        return group.commandCount;
+    }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef FRAMEDATA_H
+#define FRAMEDATA_H
+
+#include <glm/glm.hpp>
+
+// binding point of the FrameData uniform block, shared by every program
+const unsigned int FRAME_DATA_BINDING = 0;
+
+// per-frame data, laid out to match the std140 FrameData block in the shaders
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 transform;
+    glm::vec4 ourColor;
+    glm::vec4 random;
+};
+
+#endif
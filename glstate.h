@@ -0,0 +1,496 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include "libs/glad.h"
+#include <cstdint>
+#include <cstdio>
+
+// texture units and uniform buffer bindings that are shadowed, higher ones always reach the driver
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+const unsigned int GL_STATE_UNIFORM_BINDINGS = 16;
+
+// kinds of state change, counted separately
+enum class StateCall
+{
+    Program,
+    VertexArray,
+    Buffer,
+    Texture,
+    Framebuffer,
+    Capability,
+    Depth,
+    Blend,
+    Viewport,
+    Count
+};
+
+const char *const STATE_CALL_NAMES[(int)StateCall::Count] = {"program", "vertex_array", "buffer",
+                                                             "texture", "framebuffer",  "capability",
+                                                             "depth",   "blend",        "viewport"};
+
+// shadow copy of the gl binding and fixed function state, skipping calls that change nothing
+//
+// every bind in the program goes through here, otherwise the shadow goes stale; code that
+// must touch the gl directly calls invalidate() afterwards. a shadow starts out unknown, so
+// the first call of each kind is always issued. the element array buffer belongs to the
+// VAO, so binding a different VAO forgets it.
+class GLState
+{
+  public:
+    uint64_t issued[(int)StateCall::Count] = {};
+    uint64_t skipped[(int)StateCall::Count] = {};
+
+    // frames counted since the last reset, for per frame averages
+    unsigned int frames = 0;
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if (changed(StateCall::Program, program, currentProgram))
+            glUseProgram(program);
+    }
+
+    void bindVertexArray(unsigned int vertexArray)
+    {
+        if (!changed(StateCall::VertexArray, vertexArray, currentVertexArray))
+            return;
+
+        glBindVertexArray(vertexArray);
+        buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+    }
+
+    void bindBuffer(GLenum target, unsigned int buffer)
+    {
+        int slot = bufferSlot(target);
+
+        if (slot < 0)
+        {
+            count(StateCall::Buffer, true);
+            glBindBuffer(target, buffer);
+        }
+        else if (changed(StateCall::Buffer, buffer, buffers[slot]))
+        {
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    // indexed uniform buffer binding, which also becomes the generic GL_UNIFORM_BUFFER binding
+    void bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, size_t offset, size_t size)
+    {
+        if (target != GL_UNIFORM_BUFFER || index >= GL_STATE_UNIFORM_BINDINGS)
+        {
+            count(StateCall::Buffer, true);
+            glBindBufferRange(target, index, buffer, offset, size);
+            return;
+        }
+
+        UniformBinding &binding = uniformBindings[index];
+        bool same = binding.buffer == buffer && binding.offset == offset && binding.size == size &&
+                    buffers[bufferSlot(GL_UNIFORM_BUFFER)] == buffer;
+
+        count(StateCall::Buffer, !same);
+
+        if (same)
+            return;
+
+        glBindBufferRange(target, index, buffer, offset, size);
+
+        binding = {buffer, offset, size};
+        buffers[bufferSlot(GL_UNIFORM_BUFFER)] = buffer;
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (changed(StateCall::Texture, unit, currentUnit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // bind to the active texture unit
+    void bindTexture(GLenum target, unsigned int texture)
+    {
+        int slot = textureSlot(target);
+
+        if (slot < 0 || currentUnit >= GL_STATE_TEXTURE_UNITS)
+        {
+            count(StateCall::Texture, true);
+            glBindTexture(target, texture);
+        }
+        else if (changed(StateCall::Texture, texture, textures[currentUnit][slot]))
+        {
+            glBindTexture(target, texture);
+        }
+    }
+
+    void bindTexture(unsigned int unit, GLenum target, unsigned int texture)
+    {
+        activeTexture(unit);
+        bindTexture(target, texture);
+    }
+
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void bindFramebuffer(GLenum target, unsigned int framebuffer)
+    {
+        bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+        bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+        bool same = (!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer);
+
+        count(StateCall::Framebuffer, !same);
+
+        if (same)
+            return;
+
+        glBindFramebuffer(target, framebuffer);
+
+        if (draw)
+            drawFramebuffer = framebuffer;
+
+        if (read)
+            readFramebuffer = framebuffer;
+    }
+
+    void bindRenderbuffer(unsigned int renderbuffer)
+    {
+        if (changed(StateCall::Framebuffer, renderbuffer, currentRenderbuffer))
+            glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    }
+
+    void enable(GLenum capability)
+    {
+        setCapability(capability, true);
+    }
+
+    void disable(GLenum capability)
+    {
+        setCapability(capability, false);
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (changed(StateCall::Depth, function, currentDepthFunc))
+            glDepthFunc(function);
+    }
+
+    void depthMask(bool write)
+    {
+        if (changed(StateCall::Depth, write, depthWrite))
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        bool same = blendSource == source && blendDestination == destination;
+        count(StateCall::Blend, !same);
+
+        if (same)
+            return;
+
+        glBlendFunc(source, destination);
+
+        blendSource = source;
+        blendDestination = destination;
+    }
+
+    void viewport(int x, int y, int width, int height)
+    {
+        bool same = viewportKnown && viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width &&
+                    viewportRect[3] == height;
+        count(StateCall::Viewport, !same);
+
+        if (same)
+            return;
+
+        glViewport(x, y, width, height);
+
+        viewportRect[0] = x;
+        viewportRect[1] = y;
+        viewportRect[2] = width;
+        viewportRect[3] = height;
+        viewportKnown = true;
+    }
+
+    // deleting a bound object resets its bindings to 0, the shadow follows
+    void deleteBuffers(int total, const unsigned int *ids)
+    {
+        for (int i = 0; i < total; i++)
+        {
+            for (unsigned int &buffer : buffers)
+                buffer = buffer == ids[i] ? 0 : buffer;
+
+            for (UniformBinding &binding : uniformBindings)
+                binding.buffer = binding.buffer == ids[i] ? 0 : binding.buffer;
+        }
+
+        glDeleteBuffers(total, ids);
+    }
+
+    void deleteTextures(int total, const unsigned int *ids)
+    {
+        for (int i = 0; i < total; i++)
+        {
+            for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+            {
+                for (unsigned int &texture : textures[unit])
+                    texture = texture == ids[i] ? 0 : texture;
+            }
+        }
+
+        glDeleteTextures(total, ids);
+    }
+
+    void deleteVertexArrays(int total, const unsigned int *ids)
+    {
+        for (int i = 0; i < total; i++)
+        {
+            if (currentVertexArray == ids[i])
+            {
+                currentVertexArray = 0;
+                buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = 0;
+            }
+        }
+
+        glDeleteVertexArrays(total, ids);
+    }
+
+    void deleteFramebuffers(int total, const unsigned int *ids)
+    {
+        for (int i = 0; i < total; i++)
+        {
+            drawFramebuffer = drawFramebuffer == ids[i] ? 0 : drawFramebuffer;
+            readFramebuffer = readFramebuffer == ids[i] ? 0 : readFramebuffer;
+        }
+
+        glDeleteFramebuffers(total, ids);
+    }
+
+    void deleteRenderbuffers(int total, const unsigned int *ids)
+    {
+        for (int i = 0; i < total; i++)
+            currentRenderbuffer = currentRenderbuffer == ids[i] ? 0 : currentRenderbuffer;
+
+        glDeleteRenderbuffers(total, ids);
+    }
+
+    // a program in use is only flagged for deletion, but its name must not be trusted afterwards
+    void deleteProgram(unsigned int program)
+    {
+        if (currentProgram == program)
+            currentProgram = UNKNOWN;
+
+        glDeleteProgram(program);
+    }
+
+    // forget everything, for after code outside this cache changed gl state
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVertexArray = UNKNOWN;
+        currentUnit = UNKNOWN;
+        currentRenderbuffer = UNKNOWN;
+        drawFramebuffer = UNKNOWN;
+        readFramebuffer = UNKNOWN;
+
+        for (unsigned int &buffer : buffers)
+            buffer = UNKNOWN;
+
+        for (UniformBinding &binding : uniformBindings)
+            binding.buffer = UNKNOWN;
+
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+        {
+            for (unsigned int &texture : textures[unit])
+                texture = UNKNOWN;
+        }
+
+        for (unsigned int &capability : capabilities)
+            capability = UNKNOWN;
+
+        currentDepthFunc = UNKNOWN;
+        depthWrite = UNKNOWN;
+        blendSource = UNKNOWN;
+        blendDestination = UNKNOWN;
+        viewportKnown = false;
+    }
+
+    void beginFrame()
+    {
+        frames++;
+    }
+
+    void resetCounters()
+    {
+        for (int i = 0; i < (int)StateCall::Count; i++)
+            issued[i] = skipped[i] = 0;
+
+        frames = 0;
+    }
+
+    // issued and skipped calls per frame for each kind of state
+    void report(FILE *file) const
+    {
+        fprintf(file, "%-12s %10s %10s\n", "state calls", "issued", "skipped");
+
+        for (int i = 0; i < (int)StateCall::Count; i++)
+            fprintf(file, "%-12s %10.1f %10.1f\n", STATE_CALL_NAMES[i], perFrame(issued[i]), perFrame(skipped[i]));
+    }
+
+    // per frame counts as a json object body, one "kind": {...} entry per line
+    void writeJson(FILE *file) const
+    {
+        for (int i = 0; i < (int)StateCall::Count; i++)
+        {
+            fprintf(file, "    \"%s\": {\"issued\": %.2f, \"skipped\": %.2f}%s\n", STATE_CALL_NAMES[i],
+                    perFrame(issued[i]), perFrame(skipped[i]),
+                    i + 1 < (int)StateCall::Count ? "," : "");
+        }
+    }
+
+  private:
+    static const unsigned int UNKNOWN = 0xffffffff;
+
+    // shadowed targets, see bufferSlot and textureSlot
+    static const int BUFFER_SLOTS = 9;
+    static const int TEXTURE_SLOTS = 4;
+    static const int CAPABILITY_SLOTS = 5;
+
+    struct UniformBinding
+    {
+        unsigned int buffer;
+        size_t offset;
+        size_t size;
+    };
+
+    // all set by invalidate()
+    unsigned int currentProgram;
+    unsigned int currentVertexArray;
+    unsigned int currentUnit;
+    unsigned int currentRenderbuffer;
+    unsigned int drawFramebuffer;
+    unsigned int readFramebuffer;
+
+    unsigned int buffers[BUFFER_SLOTS];
+    UniformBinding uniformBindings[GL_STATE_UNIFORM_BINDINGS] = {};
+    unsigned int textures[GL_STATE_TEXTURE_UNITS][TEXTURE_SLOTS];
+    unsigned int capabilities[CAPABILITY_SLOTS];
+
+    unsigned int currentDepthFunc;
+    unsigned int depthWrite;
+    unsigned int blendSource;
+    unsigned int blendDestination;
+
+    int viewportRect[4];
+    bool viewportKnown;
+
+    void count(StateCall call, bool issue)
+    {
+        if (issue)
+            issued[(int)call]++;
+        else
+            skipped[(int)call]++;
+    }
+
+    // update a shadow, returns true when the call has to be issued
+    bool changed(StateCall call, unsigned int value, unsigned int &shadow)
+    {
+        bool different = shadow != value;
+        count(call, different);
+        shadow = value;
+
+        return different;
+    }
+
+    void setCapability(GLenum capability, bool enabled)
+    {
+        int slot = capabilitySlot(capability);
+
+        if (slot < 0)
+            count(StateCall::Capability, true);
+        else if (!changed(StateCall::Capability, enabled, capabilities[slot]))
+            return;
+
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_COPY_READ_BUFFER:
+            return 2;
+        case GL_COPY_WRITE_BUFFER:
+            return 3;
+        case GL_PIXEL_UNPACK_BUFFER:
+            return 4;
+        case GL_PIXEL_PACK_BUFFER:
+            return 5;
+        case GL_DRAW_INDIRECT_BUFFER:
+            return 6;
+        case GL_UNIFORM_BUFFER:
+            return 7;
+        case GL_TEXTURE_BUFFER:
+            return 8;
+        }
+
+        return -1;
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_2D_ARRAY:
+            return 1;
+        case GL_TEXTURE_CUBE_MAP:
+            return 2;
+        case GL_TEXTURE_BUFFER:
+            return 3;
+        }
+
+        return -1;
+    }
+
+    static int capabilitySlot(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_DEPTH_TEST:
+            return 0;
+        case GL_BLEND:
+            return 1;
+        case GL_CULL_FACE:
+            return 2;
+        case GL_SCISSOR_TEST:
+            return 3;
+        case GL_FRAMEBUFFER_SRGB:
+            return 4;
+        }
+
+        return -1;
+    }
+
+    double perFrame(uint64_t value) const
+    {
+        return frames > 0 ? (double)value / frames : 0.0;
+    }
+};
+
+// the state of the one gl context, only touched from the gl thread
+inline GLState &gl_state()
+{
+    static GLState state;
+    return state;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "libs/glad.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "glstate.h"
+
+// offscreen gl context without a window or display, backed by surfaceless EGL (e.g. Mesa llvmpipe)
+class HeadlessContext
+{
+  public:
+    bool create()
+    {
+        // prefer Mesa's surfaceless platform so no X server or gpu device is needed
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+        display = EGL_NO_DISPLAY;
+
+        if (getPlatformDisplay != NULL)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cout << "Failed to initialize EGL display" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+
+        EGLConfig config;
+        EGLint configCount = 0;
+
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            std::cout << "Failed to find an EGL config" << std::endl;
+            return false;
+        }
+
+        eglBindAPI(EGL_OPENGL_API);
+
+        const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                            3,
+                                            EGL_CONTEXT_MINOR_VERSION,
+                                            3,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                            EGL_NONE};
+
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+
+        // no surface at all, rendering goes to a framebuffer object
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "Failed to create surfaceless EGL context" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    static void *getProcAddress(const char *name)
+    {
+        return (void *)eglGetProcAddress(name);
+    }
+
+    void destroy()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+  private:
+    EGLDisplay display;
+    EGLContext context;
+};
+
+// color + depth framebuffer object to render into when there is no default framebuffer
+class RenderTarget
+{
+  public:
+    unsigned int id;
+    int width, height;
+
+    void create(int w, int h)
+    {
+        width = w;
+        height = h;
+
+        glGenFramebuffers(1, &id);
+        gl_state().bindFramebuffer(GL_FRAMEBUFFER, id);
+
+        glGenRenderbuffers(1, &color);
+        gl_state().bindRenderbuffer(color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+        glGenRenderbuffers(1, &depth);
+        gl_state().bindRenderbuffer(depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Render target is incomplete" << std::endl;
+    }
+
+    void bind()
+    {
+        gl_state().bindFramebuffer(GL_FRAMEBUFFER, id);
+    }
+
+    // read back the color attachment and write it as a binary PPM
+    bool save(const char *path)
+    {
+        std::vector<unsigned char> pixels(width * height * 3);
+
+        gl_state().bindFramebuffer(GL_READ_FRAMEBUFFER, id);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+        FILE *file = fopen(path, "wb");
+
+        if (file == NULL)
+        {
+            std::cout << "Failed to write frame " << path << std::endl;
+            return false;
+        }
+
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+        // gl rows go bottom to top, PPM rows top to bottom
+        for (int y = height - 1; y >= 0; y--)
+            fwrite(&pixels[y * width * 3], 1, width * 3, file);
+
+        fclose(file);
+
+        return true;
+    }
+
+    void destroy()
+    {
+        gl_state().deleteRenderbuffers(1, &color);
+        gl_state().deleteRenderbuffers(1, &depth);
+        gl_state().deleteFramebuffers(1, &id);
+    }
+
+  private:
+    unsigned int color;
+    unsigned int depth;
+};
+
+#endif
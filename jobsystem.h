@@ -0,0 +1,320 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "arena.h"
+
+// jobs tried by an idle worker before it goes to sleep
+const int JOB_SPIN_ATTEMPTS = 64;
+
+// jobs one queue holds, a job submitted to a full queue runs right away instead
+const unsigned int JOB_QUEUE_CAPACITY = 1024;
+
+// starting size of each thread's arena, grown by the arena itself when a frame needs more
+const size_t JOB_ARENA_SIZE = 64 * 1024;
+
+// counts the unfinished jobs of a batch, wait() on it to join them
+struct JobCounter
+{
+    std::atomic<unsigned int> pending{0};
+};
+
+// work-stealing scheduler for short frame jobs
+//
+// every worker owns a deque: it pushes and pops its own jobs at the back, newest first while
+// they're hot in its cache, and idle workers steal the oldest jobs from the front of the
+// others. jobs from outside threads are dealt round robin. each deque has its own lock, which
+// is uncontended while everyone works on their own jobs. a thread waiting on a counter runs
+// jobs meanwhile, so the gl thread helps instead of blocking and zero workers still works.
+//
+// job closures are copied into the submitting thread's arena, so running jobs never touches
+// the heap. they must be trivially destructible, capturing pointers and plain values, and
+// jobs must be finished before beginFrame() releases the arenas. only one thread besides the
+// workers may submit jobs, the one calling beginFrame().
+class JobSystem
+{
+  public:
+    void create(unsigned int threadCount)
+    {
+        // one queue more for threads that aren't workers when there are none
+        for (unsigned int i = 0; i < threadCount || i == 0; i++)
+            queues.emplace_back(new WorkQueue());
+
+        // one arena per worker and one for the submitting thread
+        for (unsigned int i = 0; i <= threadCount; i++)
+        {
+            arenas.emplace_back(new Arena());
+            arenas.back()->create(JOB_ARENA_SIZE);
+        }
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    // release the job arenas, every job of the last frame must have been waited for
+    void beginFrame()
+    {
+        for (std::unique_ptr<Arena> &arena : arenas)
+            arena->reset();
+    }
+
+    // arena of the calling thread, for job temporaries that live until the next beginFrame()
+    Arena &threadArena()
+    {
+        int worker = workerIndex();
+        return *arenas[worker >= 0 ? worker : workers.size()];
+    }
+
+    template <typename F> void run(const F &function, JobCounter &counter)
+    {
+        F *closure = threadArena().copy(function);
+        submit({[](void *data) { (*(F *)data)(); }, closure, &counter});
+    }
+
+    // split [0, count) into ranges of at most grain items and run function(begin, end) on each
+    template <typename F> void parallelFor(size_t count, size_t grain, const F &function, JobCounter &counter)
+    {
+        grain = grain > 0 ? grain : 1;
+
+        // the ranges share one copy of the function
+        const F *shared = threadArena().copy(function);
+
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            size_t end = begin + grain < count ? begin + grain : count;
+            run([shared, begin, end] { (*shared)(begin, end); }, counter);
+        }
+    }
+
+    // run jobs until every job of the counter has finished
+    void wait(JobCounter &counter)
+    {
+        int worker = workerIndex();
+
+        while (counter.pending.load(std::memory_order_acquire) > 0)
+        {
+            Job job;
+
+            if (take(worker, job))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    unsigned int workerCount() const
+    {
+        return workers.size();
+    }
+
+    // finish queued jobs and join the workers
+    void destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (std::thread &worker : workers)
+            worker.join();
+
+        workers.clear();
+        queues.clear();
+        arenas.clear();
+    }
+
+    // one line per thread arena
+    void report(FILE *file) const
+    {
+        char name[32];
+
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            snprintf(name, sizeof(name), "worker %zu", i);
+            arenas[i]->report(file, name);
+        }
+
+        arenas.back()->report(file, "submitter");
+    }
+
+  private:
+    struct Job
+    {
+        void (*function)(void *);
+        void *data;
+        JobCounter *counter;
+    };
+
+    // fixed ring of jobs, the owner works at the back and thieves at the front
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        Job jobs[JOB_QUEUE_CAPACITY];
+        size_t front = 0;
+        size_t count = 0;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::unique_ptr<Arena>> arenas;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> next{0};
+    std::atomic<unsigned int> queued{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // which worker of which system the calling thread is
+    struct WorkerSlot
+    {
+        const JobSystem *system;
+        int index;
+    };
+
+    static WorkerSlot &workerSlot()
+    {
+        static thread_local WorkerSlot slot = {NULL, -1};
+        return slot;
+    }
+
+    void submit(const Job &job)
+    {
+        job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        int worker = workerIndex();
+        size_t index = worker >= 0 ? (size_t)worker : next.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        WorkQueue &queue = *queues[index];
+
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+
+            if (queue.count < JOB_QUEUE_CAPACITY)
+            {
+                queue.jobs[(queue.front + queue.count++) % JOB_QUEUE_CAPACITY] = job;
+                queued.fetch_add(1, std::memory_order_release);
+            }
+            else
+            {
+                index = queues.size();
+            }
+        }
+
+        // rather than growing the queue
+        if (index == queues.size())
+        {
+            execute(job);
+            return;
+        }
+
+        // taking the lock orders this with a worker checking queued before it sleeps
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+
+        wake.notify_one();
+    }
+
+    int workerIndex() const
+    {
+        const WorkerSlot &slot = workerSlot();
+        return slot.system == this ? slot.index : -1;
+    }
+
+    void work(unsigned int index)
+    {
+        workerSlot() = {this, (int)index};
+
+        while (true)
+        {
+            Job job;
+            bool found = false;
+
+            for (int attempt = 0; attempt < JOB_SPIN_ATTEMPTS && !found; attempt++)
+            {
+                found = take(index, job);
+
+                if (!found)
+                    std::this_thread::yield();
+            }
+
+            if (found)
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+
+            if (stopping && queued.load(std::memory_order_acquire) == 0)
+                return;
+        }
+    }
+
+    // own jobs newest first, then the oldest job of any other queue
+    bool take(int worker, Job &job)
+    {
+        if (queued.load(std::memory_order_acquire) == 0)
+            return false;
+
+        if (worker >= 0 && popBack(*queues[worker], job))
+            return true;
+
+        size_t start = worker >= 0 ? worker + 1 : 0;
+
+        for (size_t i = 0; i < queues.size(); i++)
+        {
+            size_t victim = (start + i) % queues.size();
+
+            if ((int)victim != worker && popFront(*queues[victim], job))
+                return true;
+        }
+
+        return false;
+    }
+
+    bool popBack(WorkQueue &queue, Job &job)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.count == 0)
+            return false;
+
+        job = queue.jobs[(queue.front + --queue.count) % JOB_QUEUE_CAPACITY];
+        queued.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    bool popFront(WorkQueue &queue, Job &job)
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.count == 0)
+            return false;
+
+        job = queue.jobs[queue.front];
+        queue.front = (queue.front + 1) % JOB_QUEUE_CAPACITY;
+        queue.count--;
+        queued.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    static void execute(const Job &job)
+    {
+        job.function(job.data);
+        job.counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+#endif
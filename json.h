@@ -0,0 +1,394 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum class JsonType
+{
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+};
+
+// parsed json document node, objects keep their members in file order
+struct JsonValue
+{
+    JsonType type = JsonType::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+
+    // array elements, or object member values matching keys
+    std::vector<JsonValue> items;
+    std::vector<std::string> keys;
+
+    const JsonValue *find(const char *key) const
+    {
+        if (type != JsonType::Object)
+            return NULL;
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (keys[i] == key)
+                return &items[i];
+        }
+
+        return NULL;
+    }
+
+    double getNumber(const char *key, double fallback) const
+    {
+        const JsonValue *value = find(key);
+        return value != NULL && value->type == JsonType::Number ? value->number : fallback;
+    }
+
+    bool getBool(const char *key, bool fallback) const
+    {
+        const JsonValue *value = find(key);
+        return value != NULL && value->type == JsonType::Bool ? value->boolean : fallback;
+    }
+
+    // element of an array member, throws when it doesn't exist
+    const JsonValue &at(const char *key, size_t index) const
+    {
+        const JsonValue *value = find(key);
+
+        if (value == NULL || value->type != JsonType::Array || index >= value->items.size())
+            throw std::runtime_error(std::string("Missing json element ") + key + "[" + std::to_string(index) + "]");
+
+        return value->items[index];
+    }
+};
+
+// recursive descent parser for RFC 8259 json, throws std::runtime_error on malformed input
+class JsonParser
+{
+  public:
+    static JsonValue parse(const char *data, size_t size)
+    {
+        JsonParser parser(data, data + size);
+        JsonValue root;
+
+        parser.parseValue(root, 0);
+        parser.skipWhitespace();
+
+        if (parser.cursor != parser.end)
+            parser.fail("trailing characters");
+
+        return root;
+    }
+
+  private:
+    // deep enough for any sane document, shallow enough to never exhaust the stack
+    static const int MAX_DEPTH = 256;
+
+    const char *begin;
+    const char *cursor;
+    const char *end;
+
+    JsonParser(const char *first, const char *last) : begin(first), cursor(first), end(last)
+    {
+    }
+
+    void fail(const char *reason)
+    {
+        throw std::runtime_error(std::string("Failed to parse json at offset ") + std::to_string(cursor - begin) +
+                                 ": " + reason);
+    }
+
+    void skipWhitespace()
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+            cursor++;
+    }
+
+    void expect(char c)
+    {
+        skipWhitespace();
+
+        if (cursor == end || *cursor != c)
+            fail("unexpected character");
+
+        cursor++;
+    }
+
+    bool consume(const char *literal)
+    {
+        size_t length = strlen(literal);
+
+        if ((size_t)(end - cursor) < length || memcmp(cursor, literal, length) != 0)
+            return false;
+
+        cursor += length;
+        return true;
+    }
+
+    void parseValue(JsonValue &value, int depth)
+    {
+        if (depth > MAX_DEPTH)
+            fail("nested too deeply");
+
+        skipWhitespace();
+
+        if (cursor == end)
+            fail("unexpected end");
+
+        switch (*cursor)
+        {
+        case '{':
+            parseObject(value, depth);
+            break;
+        case '[':
+            parseArray(value, depth);
+            break;
+        case '"':
+            value.type = JsonType::String;
+            parseString(value.string);
+            break;
+        case 't':
+        case 'f':
+            value.type = JsonType::Bool;
+            value.boolean = *cursor == 't';
+
+            if (!consume(value.boolean ? "true" : "false"))
+                fail("invalid literal");
+            break;
+        case 'n':
+            if (!consume("null"))
+                fail("invalid literal");
+            break;
+        default:
+            parseNumber(value);
+            break;
+        }
+    }
+
+    void parseObject(JsonValue &value, int depth)
+    {
+        value.type = JsonType::Object;
+        cursor++;
+        skipWhitespace();
+
+        if (cursor < end && *cursor == '}')
+        {
+            cursor++;
+            return;
+        }
+
+        while (true)
+        {
+            skipWhitespace();
+
+            if (cursor == end || *cursor != '"')
+                fail("expected a member name");
+
+            value.keys.emplace_back();
+            parseString(value.keys.back());
+
+            expect(':');
+
+            value.items.emplace_back();
+            parseValue(value.items.back(), depth + 1);
+
+            skipWhitespace();
+
+            if (cursor < end && *cursor == ',')
+            {
+                cursor++;
+                continue;
+            }
+
+            expect('}');
+            return;
+        }
+    }
+
+    void parseArray(JsonValue &value, int depth)
+    {
+        value.type = JsonType::Array;
+        cursor++;
+        skipWhitespace();
+
+        if (cursor < end && *cursor == ']')
+        {
+            cursor++;
+            return;
+        }
+
+        while (true)
+        {
+            value.items.emplace_back();
+            parseValue(value.items.back(), depth + 1);
+
+            skipWhitespace();
+
+            if (cursor < end && *cursor == ',')
+            {
+                cursor++;
+                continue;
+            }
+
+            expect(']');
+            return;
+        }
+    }
+
+    void parseString(std::string &out)
+    {
+        cursor++;
+
+        while (true)
+        {
+            if (cursor == end)
+                fail("unterminated string");
+
+            char c = *cursor++;
+
+            if (c == '"')
+                return;
+
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+
+            if (cursor == end)
+                fail("unterminated escape");
+
+            switch (*cursor++)
+            {
+            case '"':
+                out += '"';
+                break;
+            case '\\':
+                out += '\\';
+                break;
+            case '/':
+                out += '/';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u':
+                appendUtf8(out, parseCodePoint());
+                break;
+            default:
+                fail("invalid escape");
+            }
+        }
+    }
+
+    unsigned int parseHex4()
+    {
+        if (end - cursor < 4)
+            fail("truncated unicode escape");
+
+        unsigned int value = 0;
+
+        for (int i = 0; i < 4; i++)
+        {
+            char c = *cursor++;
+            value <<= 4;
+
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                fail("invalid unicode escape");
+        }
+
+        return value;
+    }
+
+    // \uXXXX, joining utf-16 surrogate pairs
+    unsigned int parseCodePoint()
+    {
+        unsigned int code = parseHex4();
+
+        if (code >= 0xd800 && code < 0xdc00 && consume("\\u"))
+        {
+            unsigned int low = parseHex4();
+
+            if (low >= 0xdc00 && low < 0xe000)
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+
+        return code;
+    }
+
+    static void appendUtf8(std::string &out, unsigned int code)
+    {
+        if (code < 0x80)
+        {
+            out += (char)code;
+        }
+        else if (code < 0x800)
+        {
+            out += (char)(0xc0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000)
+        {
+            out += (char)(0xe0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+        else
+        {
+            out += (char)(0xf0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3f));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+    }
+
+    void parseNumber(JsonValue &value)
+    {
+        // strtod needs a terminator, numbers are short so copy the candidate characters
+        char buffer[64];
+        size_t length = 0;
+
+        while (cursor + length < end && length < sizeof(buffer) - 1 && strchr("+-0123456789.eE", cursor[length]) &&
+               cursor[length] != '\0')
+        {
+            buffer[length] = cursor[length];
+            length++;
+        }
+
+        buffer[length] = '\0';
+
+        char *parsed;
+        value.type = JsonType::Number;
+        value.number = strtod(buffer, &parsed);
+
+        if (parsed == buffer)
+            fail("unexpected character");
+
+        cursor += parsed - buffer;
+    }
+};
+
+#endif
@@ -1,20 +1,46 @@
 #include "libs/glad.c"
 #include <GLFW/glfw3.h>
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <glm/ext/scalar_constants.hpp>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <strings.h>
+#include <thread>
+#include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "libs/stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "arena.h"
+#include "atlas.h"
 #include "camera.h"
+#include "bench.h"
+#include "drawbatch.h"
+#include "framedata.h"
+#include "glstate.h"
+#include "headless.h"
+#include "jobsystem.h"
+#include "mesh.h"
+#include "meshloader.h"
+#include "meshpool.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
 #include "shader.h"
+#include "simulation.h"
+#include "texture.h"
+#include "transform.h"
 
 using namespace std;
 
@@ -25,6 +51,98 @@ bool firstMouse = true;
 float lastX = WIDTH / 2.0f;
 float lastY = HEIGHT / 2.0f;
 
+// mouse movement since the last simulation step, gathered on the window thread
+SimulationInput mouseInput;
+
+// framebuffer size set on the window thread, applied by the render thread before its next frame
+std::atomic<bool> framebufferResized(false);
+std::atomic<int> framebufferWidth(WIDTH);
+std::atomic<int> framebufferHeight(HEIGHT);
+
+// how the cube field is submitted, selectable from the command line to A/B frame times
+enum class RenderMode
+{
+    PerDraw,
+    Instanced,
+    // sorted and merged into one multi-draw per program and texture
+    Indirect
+};
+
+const char *renderModeName(RenderMode mode)
+{
+    switch (mode)
+    {
+    case RenderMode::PerDraw:
+        return "per-draw";
+    case RenderMode::Instanced:
+        return "instanced";
+    case RenderMode::Indirect:
+        return "indirect";
+    }
+
+    return "unknown";
+}
+
+RenderMode nextRenderMode(RenderMode mode)
+{
+    if (mode == RenderMode::Instanced)
+        return RenderMode::PerDraw;
+    else if (mode == RenderMode::PerDraw)
+        return RenderMode::Indirect;
+
+    return RenderMode::Instanced;
+}
+
+struct Options
+{
+    RenderMode renderMode = RenderMode::Instanced;
+    unsigned int cubeCount = 10;
+    bool cull = true;
+    bool compactVertices = true;
+
+    // block compress the atlas with its mipmaps into the texture cache, when the driver takes BC1/BC3
+    bool compressTextures = true;
+
+    // filter the mipmaps are built with on the cpu, box for what the driver would make
+    MipFilter mipFilter = MipFilter::Kaiser;
+
+    // workers building the draw lists next to the gl thread, one per spare core unless given
+    int threads = -1;
+
+    // OBJ or GLB files drawn in place of the cube, the objects take turns using them
+    std::vector<const char *> meshPaths;
+
+    // images packed into the texture atlas, directories add every image in them, the objects take turns using them
+    std::vector<const char *> imagePaths;
+
+    // render offscreen through EGL instead of a window, for machines without a display
+    bool headless = false;
+    unsigned int frames = 0;
+    const char *dumpDirectory = NULL;
+
+    // replay a scripted camera path with a fixed time step and report frame timings
+    bool bench = false;
+    const char *benchOutput = "bench.json";
+
+    // time the phases of each frame on cpu and gpu and print them on exit
+    bool profile = false;
+
+    // check every transform kernel the cpu runs against glm and exit
+    bool verifyTransforms = false;
+};
+
+// frame time step used for headless and benchmark runs instead of the window clock, a whole number of
+// simulation steps so frames land exactly on one
+const double FIXED_TIME_STEP = 1.0 / 60.0;
+
+// frames measured by a benchmark run unless --frames is given
+const unsigned int BENCH_DEFAULT_FRAMES = 600;
+
+// objects culled and sorted by one job, each chunk fills its own render queue
+const unsigned int DRAW_LIST_CHUNK = 4096;
+
+// starting size of the per-frame arena, it grows on its own if a frame needs more
+const size_t FRAME_ARENA_SIZE = 1 << 20;
 
 Camera camera(
     glm::vec3(0.0f, 0.0f, 3.0f),
@@ -84,14 +202,37 @@ glm::vec3 cubePositions[] = {glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(2.0f, 5.0
                              glm::vec3(1.3f, -2.0f, -2.5f),  glm::vec3(1.5f, 2.0f, -2.5f),
                              glm::vec3(1.5f, 0.2f, -1.5f),   glm::vec3(-1.3f, 1.0f, -1.5f)};
 
-unsigned int indices[] = {
-    0, 1, 3, // first triangle
-    1, 2, 3  // second triangle
+// per-instance model matrix occupies four consecutive attribute locations
+const unsigned int INSTANCE_MODEL_LOCATION = 2;
+
+// per-instance index of the atlas image an object is textured with
+const unsigned int INSTANCE_IMAGE_LOCATION = 7;
+
+// texture unit of the atlas region buffer, the atlas itself is on unit 0
+const unsigned int ATLAS_REGION_UNIT = 1;
+
+// image files the atlas takes from directories given with --image
+const char *const IMAGE_EXTENSIONS[] = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+
+// added to a mesh's radius for the vertex shader's random offset (at most ~0.21), its transform only rotates
+const float VERTEX_OFFSET_MARGIN = 0.25f;
+
+// uniform locations resolved once after the program is linked
+struct Uniforms
+{
+    int model;
+    int image;
+    int instanced;
 };
 
 class Application
 {
   public:
+    Application(Options opts)
+    {
+        options = opts;
+    }
+
     void run()
     {
         init();
@@ -100,19 +241,144 @@ class Application
     }
 
   private:
+    Options options;
+
     Shader shader;
+    Uniforms uniforms;
+    FrameData frameData;
+    RingBuffer ringBuffer;
+    int uniformAlignment;
     GLFWwindow *window;
 
-    unsigned int VBO;
-    unsigned int VAO;
-    unsigned int EBO;
+    HeadlessContext headless;
+    RenderTarget renderTarget;
+    unsigned int frameIndex = 0;
+
+    Bench bench;
+    CameraPath cameraPath;
+    Profiler profiler;
+
+    // every mesh lives in the pool, so switching between them needs no VAO change
+    MeshPool meshPool;
+    MeshLoader meshLoader;
+    Mesh cubeMesh;
+
+    // what the objects draw in turn, the cube or the imported meshes
+    std::vector<Mesh *> meshes;
+    RenderQueue renderQueue;
+    DrawBatch batch;
 
-    unsigned int texture;
+    // the sort keys hold these dense ids instead of the gl names of the shader and atlas
+    RenderStateIds programIds;
+    RenderStateIds textureIds;
+    unsigned int programId;
+    unsigned int textureId;
 
-    float deltaTime;
-    float lastFrame;
+    // workers cull and sort a chunk of objects each, the gl thread merges and replays the result
+    JobSystem jobs;
+    std::vector<RenderQueue> chunkQueues;
+
+    // the render thread's temporaries, released at the start of the next frame
+    Arena frameArena;
+
+    // culling results of this frame, in frameArena
+    unsigned int *visibleCubes = NULL;
+    unsigned int *chunkVisible = NULL;
+
+    // every image the objects use, so switching between them needs no texture change
+    TextureAtlas *atlas;
+    TextureLoader textureLoader;
+
+    TransformStore cubeTransforms;
+    MatrixArray modelMatrices;
+    std::vector<glm::vec4> cubeBounds;
+    std::vector<uint32_t> cubeImages;
+
+    unsigned int visibleCount;
+    unsigned int drawCalls;
+
+    // where this frame's instance matrices, image indices and indirect commands start in the ring buffer
+    size_t instanceOffset = 0;
+    size_t imageOffset = 0;
+    size_t commandOffset = 0;
+
+    // stepped at a fixed rate, on the window thread in interactive runs and before each frame otherwise
+    Simulation simulation;
+    SnapshotBuffer snapshots;
+
+    // simulation time zero on the window clock
+    double clockStart = 0.0;
+
+    bool toggleHeld = false;
+
+    // render mode switches requested by the window thread, applied by the render thread
+    std::atomic<unsigned int> modeToggles{0};
+
+    // cleared when the render thread stops on its own, such as after --frames
+    std::atomic<bool> rendering{false};
+
+    double titleTime = 0.0;
+    unsigned int titleFrames = 0;
+
+    // window titles can only be set from the window thread
+    std::mutex titleMutex;
+    std::string pendingTitle;
 
     void init()
+    {
+        if (options.headless)
+            initHeadless();
+        else
+            initWindow();
+
+        gl_state().enable(GL_DEPTH_TEST);
+
+        gl_state().viewport(0, 0, WIDTH, HEIGHT);
+
+        unsigned int cores = std::thread::hardware_concurrency();
+        jobs.create(options.threads >= 0 ? options.threads : (cores > 1 ? cores - 1 : 0));
+
+        loadVertices();
+        loadTexture();
+        loadInstances();
+
+        programIds.create(RENDER_KEY_PROGRAM_BITS);
+        textureIds.create(RENDER_KEY_TEXTURE_BITS);
+        programId = programIds.add(shader.id);
+        textureId = textureIds.add(atlas->texture);
+
+        simulation.create(camera.position, camera.front, camera.speed);
+
+        if (options.bench)
+        {
+            bench.create();
+            cameraPath = CameraPath::flythrough();
+
+            glm::vec3 position;
+            float yaw, pitch;
+
+            cameraPath.sample(0.0f, position, yaw, pitch);
+            simulation.place(position, yaw, pitch);
+        }
+
+        snapshots.reset(simulation.state);
+
+        if (options.bench || options.profile)
+            profiler.create();
+    }
+
+    void initHeadless()
+    {
+        if (!headless.create())
+            throw runtime_error("Failed to create headless context");
+
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+            throw runtime_error("Failed to initialize GLAD");
+
+        renderTarget.create(WIDTH, HEIGHT);
+    }
+
+    void initWindow()
     {
         glfwInit();
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -140,181 +406,795 @@ class Application
             return;
         }
 
-        glEnable(GL_DEPTH_TEST);
-
-        glViewport(0, 0, WIDTH, HEIGHT);
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
         glfwSetWindowAspectRatio(window, 8, 6);
 
         glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
-        glfwSetCursorPosCallback(window, mouseMoveCallback);
 
-        loadVertices();
-        loadTexture();
+        // benchmarks follow the scripted path only, and must not be throttled by vsync
+        if (options.bench)
+            glfwSwapInterval(0);
+        else
+            glfwSetCursorPosCallback(window, mouseMoveCallback);
     }
 
     void loadVertices()
     {
         shader = Shader("./shaders/vertex.glsl", "./shaders/fragment.glsl");
 
-        // vertex buffer
-        glGenBuffers(1, &VBO);
+        uniforms.model = shader.getUniform("model");
+        uniforms.image = shader.getUniform("image");
+        uniforms.instanced = shader.getUniform("instanced");
 
-        // create vertex attribute object
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+        // weld the expanded cube into an indexed mesh
+        MeshBuilder builder;
+        builder.addTriangles(cubeVertices, sizeof(cubeVertices) / (5 * sizeof(float)));
+        builder.optimize();
 
-        // send to gpu
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
-        glEnableVertexAttribArray(0);
+        // imported meshes can hold anything, so their pool gets float positions and room for normals
+        VertexFormat format;
 
-        // define element buffer object
-        glGenBuffers(1, &EBO);
+        if (!options.meshPaths.empty())
+            format = options.compactVertices ? VertexFormat::compact(true, HUGE_VALF, false) : VertexFormat::full(true);
+        else
+            format = options.compactVertices ? builder.compactFormat() : VertexFormat::full(false);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        meshPool.create(format, builder.vertices.size(), builder.indices.size());
+        meshLoader.create(options.compactVertices, &meshPool);
+        batch.create();
+
+        if (options.meshPaths.empty())
+        {
+            meshPool.add(cubeMesh, builder);
+            meshes.push_back(&cubeMesh);
+        }
+
+        for (const char *path : options.meshPaths)
+            meshes.push_back(meshLoader.load(path));
+
+        if (options.headless || options.bench)
+            meshLoader.finish();
 
         shader.use();
     }
 
     void loadTexture()
     {
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        std::vector<std::string> paths;
+
+        for (const char *path : options.imagePaths)
+        {
+            std::vector<std::string> files = list_directory(path);
+
+            if (files.empty())
+                paths.push_back(path);
+
+            for (const std::string &file : files)
+            {
+                if (isImage(file))
+                    paths.push_back(file);
+            }
+        }
 
-        // texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        if (paths.empty())
+            paths.push_back("./assets/niko.png");
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        textureLoader.create(options.compressTextures, options.mipFilter);
+        atlas = textureLoader.loadAtlas(paths);
 
-        // load image data
-        int width, height, nrChannels;
-        stbi_set_flip_vertically_on_load(true);
-        unsigned char *imageData = stbi_load("./assets/niko.png", &width, &height, &nrChannels, 0);
+        shader.setInt(shader.getUniform("atlasRegions"), ATLAS_REGION_UNIT);
 
-        if (imageData)
+        // offscreen runs compare frames, so they start with every image in place
+        if (options.headless || options.bench)
+            textureLoader.finish();
+    }
+
+    static bool isImage(const std::string &path)
+    {
+        for (const char *extension : IMAGE_EXTENSIONS)
         {
-            // generate opengl texture
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData);
-            glGenerateMipmap(GL_TEXTURE_2D);
+            size_t length = strlen(extension);
+
+            if (path.size() >= length && strcasecmp(path.c_str() + path.size() - length, extension) == 0)
+                return true;
         }
-        else
+
+        return false;
+    }
+
+    void loadInstances()
+    {
+        // the first cubes keep their hand placed positions, the rest fill a grid behind them
+        modelMatrices.resize(options.cubeCount);
+        cubeBounds.resize(options.cubeCount);
+        cubeImages.resize(options.cubeCount);
+        renderQueue.create(options.cubeCount);
+        frameArena.create(FRAME_ARENA_SIZE);
+
+        unsigned int chunkCount = (options.cubeCount + DRAW_LIST_CHUNK - 1) / DRAW_LIST_CHUNK;
+        chunkQueues.resize(chunkCount);
+
+        for (unsigned int i = 0; i < chunkCount; i++)
+            chunkQueues[i].create(std::min(DRAW_LIST_CHUNK, options.cubeCount - i * DRAW_LIST_CHUNK));
+
+        unsigned int fieldWidth = (unsigned int)ceil(cbrt((double)options.cubeCount));
+
+        for (unsigned int i = 0; i < options.cubeCount; i++)
         {
-            cout << "Failed to load texture" << endl;
+            glm::vec3 position;
+
+            if (i < sizeof(cubePositions) / sizeof(cubePositions[0]))
+            {
+                position = cubePositions[i];
+            }
+            else
+            {
+                unsigned int x = i % fieldWidth;
+                unsigned int y = (i / fieldWidth) % fieldWidth;
+                unsigned int z = i / (fieldWidth * fieldWidth);
+
+                position = glm::vec3(
+                    (x - fieldWidth / 2.0f) * 2.5f,
+                    (y - fieldWidth / 2.0f) * 2.5f,
+                    -20.0f - z * 2.5f
+                );
+            }
+
+            float angle = 20.0f * i;
+            cubeTransforms.add(position, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+
+            cubeBounds[i] = glm::vec4(position, objectMesh(i).radius + VERTEX_OFFSET_MARGIN);
+            cubeImages[i] = i % atlas->imageCount;
         }
 
-        stbi_image_free(imageData);
+        buildModelMatrices(cubeTransforms, modelMatrices.data());
+
+        // frame data and instance data are streamed through the ring buffer every frame
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        ringBuffer.create(sizeof(FrameData) + uniformAlignment + modelMatrices.size() * sizeof(glm::mat4) + 64 +
+                          cubeImages.size() * sizeof(uint32_t) + 4 +
+                          modelMatrices.size() * sizeof(DrawElementsIndirectCommand) + 4);
+
+        gl_state().bindVertexArray(meshPool.VAO);
+        setInstanceBase(0);
 
-        // add texcoords to vertex format
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+        // a mat4 attribute is fed as four vec4 columns advancing once per instance
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            unsigned int location = INSTANCE_MODEL_LOCATION + column;
+
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+
+        glEnableVertexAttribArray(INSTANCE_IMAGE_LOCATION);
+        glVertexAttribDivisor(INSTANCE_IMAGE_LOCATION, 1);
+    }
+
+    // point the instance attributes at this frame's data in the ring buffer, starting from instance base
+    void setInstanceBase(uint32_t base)
+    {
+        size_t offset = instanceOffset + base * sizeof(glm::mat4);
+
+        gl_state().bindBuffer(GL_ARRAY_BUFFER, ringBuffer.id);
+
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void *)(offset + column * sizeof(glm::vec4)));
+        }
+
+        glVertexAttribIPointer(INSTANCE_IMAGE_LOCATION, 1, GL_UNSIGNED_INT, sizeof(uint32_t),
+                               (void *)(imageOffset + base * sizeof(uint32_t)));
     }
 
     void update()
     {
-        deltaTime = 0.0f;	// Time between current frame and last frame
-        lastFrame = 0.0f; // Time of last frame
+        if (threaded())
+        {
+            runThreaded();
+        }
+        else
+        {
+            // simulate up to each frame's time first, so runs are reproducible
+            while (running())
+            {
+                double time = frameIndex * FIXED_TIME_STEP;
+
+                simulateUntil(time);
+                renderFrame(time);
+            }
+        }
+
+        if (options.bench)
+            bench.finish(options.benchOutput, renderModeName(options.renderMode), profiler);
+        else if (options.profile)
+            profiler.report(stdout);
+
+        if (options.profile)
+        {
+            reportArenas(stdout);
+
+            printf("\n");
+            atlas->report(stdout);
+        }
+    }
+
+    // capacity and high water mark of the frame allocators
+    void reportArenas(FILE *file)
+    {
+        fprintf(file, "\n");
+        report_arena_header(file);
+
+        frameArena.report(file, "frame");
+        jobs.report(file);
+
+        fprintf(file, "%-12s %10.1f %10.1f %10s\n", "ring frame", ringBuffer.frameCapacity() / 1024.0,
+                ringBuffer.highWater / 1024.0, "-");
+    }
+
+    // interactive runs draw on a render thread that owns the context, while this thread waits for
+    // window events and steps the simulation in real time, so neither waits for the gpu
+    bool threaded() const
+    {
+        return !options.headless && !options.bench;
+    }
+
+    void runThreaded()
+    {
+        rendering = true;
+        clockStart = glfwGetTime();
+
+        glfwMakeContextCurrent(NULL);
 
-        while (!glfwWindowShouldClose(window))
+        std::thread renderThread([this] {
+            glfwMakeContextCurrent(window);
+
+            // a step behind the newest snapshot, so there are two states to blend between
+            while (running())
+                renderFrame(glfwGetTime() - clockStart - SIMULATION_STEP);
+
+            glfwMakeContextCurrent(NULL);
+
+            rendering = false;
+            glfwPostEmptyEvent();
+        });
+
+        while (rendering && !glfwWindowShouldClose(window))
         {
-            processInput();
+            double now = glfwGetTime() - clockStart;
 
-            float time = glfwGetTime();
-            deltaTime = time - lastFrame;
-            lastFrame = time;
+            while (simulation.nextTime() <= now)
+            {
+                simulation.step(gatherInput());
+                snapshots.publish(simulation.state);
+            }
+
+            showTitle();
+
+            glfwWaitEventsTimeout(simulation.nextTime() - now);
+        }
+
+        // stops the render thread when the loop ended on a window event
+        glfwSetWindowShouldClose(window, true);
+        renderThread.join();
 
-            float greenValue = (sin(time) / 2.0f) + 0.5f;
-            float redValue = (sin(time) / 1.0f) + 0.8f;
-            float blueValue = (sin(time) / 3.0f) + 0.1f;
+        glfwMakeContextCurrent(window);
+    }
+
+    // steps without real time input, benchmarks follow their camera path
+    void simulateUntil(double time)
+    {
+        while (simulation.state.time < time)
+        {
+            if (options.bench)
+            {
+                glm::vec3 position;
+                float yaw, pitch;
+
+                cameraPath.sample(simulation.nextTime(), position, yaw, pitch);
+                simulation.step(position, yaw, pitch);
+            }
+            else
+            {
+                simulation.step(SimulationInput());
+            }
+
+            snapshots.publish(simulation.state);
+        }
+    }
+
+    void renderFrame(double time)
+    {
+        // nothing from the last frame is referenced anymore, its jobs have all been waited for
+        frameArena.reset();
+        jobs.beginFrame();
+
+        profiler.beginFrame();
+
+        if (options.bench)
+            bench.beginFrame(frameIndex);
+
+        gl_state().beginFrame();
+
+        {
+            PROFILE_SCOPE(profiler, "input");
+
+            applyWindowEvents();
+
+            SimulationState state = snapshots.sample(time);
+            camera.position = state.position;
+            camera.front = state.front;
+        }
+
+        {
+            PROFILE_SCOPE(profiler, "clear");
+
+            if (options.headless)
+                renderTarget.bind();
 
             glClearColor(0.4f, 0.1f, 0.3f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-            shader.use();
+        {
+            PROFILE_SCOPE(profiler, "cull");
 
             camera.updateView();
+            cullCubes();
+        }
+
+        ringBuffer.beginFrame();
+
+        {
+            PROFILE_SCOPE(profiler, "upload");
+
+            textureLoader.update();
 
-            shader.setMat4("view", camera.view);
-            shader.setMat4("projection", camera.projection);
+            if (meshLoader.update() > 0)
+                updateBounds();
 
-            glm::mat4 trans = glm::mat4(1.0f);
-            trans = glm::rotate(trans, time, glm::vec3(0.0, 0.0, 1.0));
+            uploadFrame(time);
+        }
+
+        {
+            PROFILE_SCOPE(profiler, "draw");
+
+            drawCubes();
+        }
 
-            shader.setMat4("transform", trans);
-            shader.setVec4("ourColor", 0.0f, greenValue, 0.0f, 1.0f);
-            shader.setVec3("random", redValue, greenValue, blueValue);
+        ringBuffer.endFrame();
 
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glBindVertexArray(VAO);
+        if (options.bench)
+            bench.endFrame();
 
-            for (unsigned int i = 0; i < 10; i++)
+        {
+            PROFILE_SCOPE(profiler, "present");
+
+            if (options.headless)
             {
-                glm::mat4 model = glm::mat4(1.0f);
-                model = glm::translate(model, cubePositions[i]);
-                float angle = 20.0f * i;
-                model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-                shader.setMat4("model", model);
+                dumpFrame();
+            }
+            else
+            {
+                updateTitle(time);
+
+                glfwSwapBuffers(window);
 
-                glDrawArrays(GL_TRIANGLES, 0, 36);
+                if (!threaded())
+                    glfwPollEvents();
             }
+        }
+
+        frameIndex++;
+    }
+
+    // write the frame data, the visible instance matrices and the draw commands into the ring buffer
+    void uploadFrame(double time)
+    {
+        // time stays double here, as a float it gets too coarse to animate smoothly after a few hours
+        float wave = (float)sin(time);
+        float greenValue = (wave / 2.0f) + 0.5f;
+        float redValue = (wave / 1.0f) + 0.8f;
+        float blueValue = (wave / 3.0f) + 0.1f;
 
-            glfwSwapBuffers(window);
-            glfwPollEvents();
+        // the angle only matters modulo a turn, wrapped before glm rounds it to float
+        float angle = (float)fmod(time, 2.0 * M_PI);
+
+        camera.fillFrameData(frameData);
+        frameData.transform = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0, 0.0, 1.0));
+        frameData.ourColor = glm::vec4(0.0f, greenValue, 0.0f, 1.0f);
+        frameData.random = glm::vec4(redValue, greenValue, blueValue, 0.0f);
+
+        RingAllocation frameAllocation = ringBuffer.allocate(sizeof(FrameData), uniformAlignment);
+        memcpy(frameAllocation.data, &frameData, sizeof(FrameData));
+
+        buildDrawList();
+
+        if (options.renderMode != RenderMode::PerDraw)
+        {
+            batch.build(renderQueue, frameArena);
+
+            // matrices and images in the order the commands consume them
+            RingAllocation instanceAllocation = ringBuffer.allocate(batch.instanceCount * sizeof(glm::mat4), 64);
+            RingAllocation imageAllocation = ringBuffer.allocate(batch.instanceCount * sizeof(uint32_t), 4);
+            glm::mat4 *instances = (glm::mat4 *)instanceAllocation.data;
+            uint32_t *images = (uint32_t *)imageAllocation.data;
+
+            JobCounter copied;
+            jobs.parallelFor(batch.instanceCount, DRAW_LIST_CHUNK, [this, instances, images](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    memcpy(&instances[i], &modelMatrices[batch.instances[i]], sizeof(glm::mat4));
+                    images[i] = cubeImages[batch.instances[i]];
+                }
+            }, copied);
+            jobs.wait(copied);
+
+            instanceOffset = instanceAllocation.offset;
+            imageOffset = imageAllocation.offset;
+
+            if (options.renderMode == RenderMode::Indirect && batch.multiDraw)
+            {
+                size_t size = batch.commandCount * sizeof(DrawElementsIndirectCommand);
+                RingAllocation commandAllocation = ringBuffer.allocate(size, 4);
+
+                memcpy(commandAllocation.data, batch.commands, size);
+                commandOffset = commandAllocation.offset;
+            }
+        }
+
+        ringBuffer.flush();
+
+        gl_state().bindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ringBuffer.id, frameAllocation.offset,
+                                   sizeof(FrameData));
+    }
+
+    void drawCubes()
+    {
+        shader.use();
+
+        gl_state().bindTexture(ATLAS_REGION_UNIT, GL_TEXTURE_BUFFER, atlas->regionTexture);
+        gl_state().bindTexture(0, GL_TEXTURE_2D_ARRAY, atlas->texture);
+        gl_state().bindVertexArray(meshPool.VAO);
+
+        if (options.renderMode != RenderMode::PerDraw)
+        {
+            bool indirect = options.renderMode == RenderMode::Indirect;
+
+            shader.setBool(uniforms.instanced, true);
+            setInstanceBase(0);
+
+            if (indirect && batch.multiDraw)
+                gl_state().bindBuffer(GL_DRAW_INDIRECT_BUFFER, ringBuffer.id);
+
+            // the state cache skips the binds while groups share the program and atlas bound above
+            for (size_t i = 0; i < batch.groupCount; i++)
+            {
+                const DrawGroup &group = batch.groups[i];
+
+                gl_state().useProgram(programIds.name(group.program));
+                gl_state().bindTexture(0, GL_TEXTURE_2D_ARRAY, textureIds.name(group.texture));
+
+                drawCalls += batch.draw(group, indirect, commandOffset,
+                                        [this](uint32_t baseInstance) { setInstanceBase(baseInstance); });
+            }
+        }
+        else
+        {
+            shader.setBool(uniforms.instanced, false);
+
+            for (const RenderItem &item : renderQueue)
+            {
+                shader.setMat4(uniforms.model, modelMatrices[item.instance]);
+                shader.setUint(uniforms.image, cubeImages[item.instance]);
+
+                item.mesh->draw();
+                drawCalls++;
+            }
         }
     }
 
+    const Mesh &objectMesh(unsigned int object) const
+    {
+        return *meshes[object % meshes.size()];
+    }
+
+    bool running()
+    {
+        if (options.headless)
+            return frameIndex < options.frames;
+
+        return !glfwWindowShouldClose(window) && (options.frames == 0 || frameIndex < options.frames);
+    }
+
+    void dumpFrame()
+    {
+        if (options.dumpDirectory == NULL)
+            return;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/frame_%05u.ppm", options.dumpDirectory, frameIndex);
+
+        renderTarget.save(path);
+    }
+
     void cleanup()
     {
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
+        jobs.destroy();
+        meshLoader.destroy();
+        meshPool.destroy();
+        ringBuffer.destroy();
+        profiler.destroy();
+        textureLoader.destroy();
+
+        if (options.headless)
+        {
+            renderTarget.destroy();
+            headless.destroy();
+        }
+        else
+        {
+            glfwTerminate();
+        }
+    }
 
-        glfwTerminate();
+    // bounding spheres follow the mesh radii, which change when imported meshes arrive
+    void updateBounds()
+    {
+        for (unsigned int i = 0; i < cubeBounds.size(); i++)
+            cubeBounds[i].w = objectMesh(i).radius + VERTEX_OFFSET_MARGIN;
     }
 
-    void processInput()
+    // gather the cubes intersecting the view frustum, each chunk's into the start of its own range of visibleCubes
+    void cullCubes()
+    {
+        drawCalls = 0;
+
+        visibleCubes = frameArena.allocate<unsigned int>(cubeBounds.size());
+        chunkVisible = frameArena.allocate<unsigned int>(chunkQueues.size());
+
+        JobCounter culled;
+        jobs.parallelFor(cubeBounds.size(), DRAW_LIST_CHUNK, [this](size_t begin, size_t end) {
+            unsigned int *visible = &visibleCubes[begin];
+            size_t count = end - begin;
+
+            if (options.cull)
+            {
+                count = camera.cullSpheres(&cubeBounds[begin], count, visible);
+
+                for (size_t i = 0; i < count; i++)
+                    visible[i] += begin;
+            }
+            else
+            {
+                for (size_t i = 0; i < count; i++)
+                    visible[i] = begin + i;
+            }
+
+            chunkVisible[begin / DRAW_LIST_CHUNK] = count;
+        }, culled);
+        jobs.wait(culled);
+
+        visibleCount = 0;
+
+        for (size_t i = 0; i < chunkQueues.size(); i++)
+            visibleCount += chunkVisible[i];
+    }
+
+    // submit the visible objects of every chunk to its queue and sort it on the workers, then merge the
+    // chunks into renderQueue, which ends up the same however many threads did the work
+    void buildDrawList()
+    {
+        JobCounter sorted;
+        jobs.parallelFor(chunkQueues.size(), 1, [this](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++)
+            {
+                RenderQueue &queue = chunkQueues[chunk];
+                const unsigned int *visible = &visibleCubes[chunk * DRAW_LIST_CHUNK];
+
+                queue.clear();
+
+                for (unsigned int i = 0; i < chunkVisible[chunk]; i++)
+                {
+                    unsigned int object = visible[i];
+                    const Mesh &mesh = objectMesh(object);
+
+                    // meshes still loading are left out
+                    if (mesh.indexCount == 0)
+                        continue;
+
+                    float depth = glm::dot(glm::vec3(cubeBounds[object]) - camera.position, camera.front);
+                    queue.submit(0, RenderLayer::Opaque, programId, textureId, mesh, depth, object);
+                }
+
+                queue.sort();
+            }
+        }, sorted);
+        jobs.wait(sorted);
+
+        renderQueue.merge(chunkQueues.data(), chunkQueues.size());
+    }
+
+    // show the active render mode and average frame time, refreshed once per second
+    void updateTitle(double time)
+    {
+        titleFrames++;
+
+        if (time - titleTime < 1.0)
+            return;
+
+        const char *mode = renderModeName(options.renderMode);
+
+        char title[128];
+        snprintf(title, sizeof(title), "Cubes - %u/%u cubes visible, %u draws, %s, %.3f ms", visibleCount,
+                 (unsigned int)modelMatrices.size(), drawCalls, mode, (time - titleTime) * 1000.0 / titleFrames);
+
+        {
+            std::lock_guard<std::mutex> lock(titleMutex);
+            pendingTitle = title;
+        }
+
+        if (!threaded())
+            showTitle();
+
+        titleTime = time;
+        titleFrames = 0;
+    }
+
+    void showTitle()
+    {
+        std::lock_guard<std::mutex> lock(titleMutex);
+
+        if (pendingTitle.empty())
+            return;
+
+        glfwSetWindowTitle(window, pendingTitle.c_str());
+        pendingTitle.clear();
+    }
+
+    // window events the window thread left for the render thread
+    void applyWindowEvents()
+    {
+        if (framebufferResized.exchange(false))
+            gl_state().viewport(0, 0, framebufferWidth, framebufferHeight);
+
+        for (unsigned int toggles = modeToggles.exchange(0); toggles > 0; toggles--)
+            options.renderMode = nextRenderMode(options.renderMode);
+    }
+
+    // poll the keys for the next simulation step, on the window thread
+    SimulationInput gatherInput()
     {
         // quit program
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             glfwSetWindowShouldClose(window, true);
 
-        // handle movement
-        float speed = camera.speed * deltaTime;
+        // cycle through the submission modes
+        bool togglePressed = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+
+        if (togglePressed && !toggleHeld)
+            modeToggles++;
 
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            camera.position += speed * camera.front;
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            camera.position -= speed * camera.front;
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            camera.position -= glm::normalize(glm::cross(camera.front, camera.up)) * speed;
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            camera.position += glm::normalize(glm::cross(camera.front, camera.up)) * speed;
+        toggleHeld = togglePressed;
 
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-            camera.position += speed * camera.up;
-        if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-            camera.position -= speed * camera.up;
+        // the mouse moves the first step after it, movement keys count while held
+        SimulationInput input = mouseInput;
+        mouseInput = SimulationInput();
+
+        input.move.x = pressed(GLFW_KEY_D) - pressed(GLFW_KEY_A);
+        input.move.y = pressed(GLFW_KEY_SPACE) - pressed(GLFW_KEY_LEFT_SHIFT);
+        input.move.z = pressed(GLFW_KEY_W) - pressed(GLFW_KEY_S);
+
+        return input;
+    }
+
+    float pressed(int key)
+    {
+        return glfwGetKey(window, key) == GLFW_PRESS ? 1.0f : 0.0f;
     }
 };
 
 void framebufferSizeCallback(GLFWwindow *window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
+    framebufferResized = true;
 }
 
 void mouseMoveCallback(GLFWwindow* window, double xpos, double ypos)
 {
-    camera.moveFromMouse(xpos, ypos);
+    if (firstMouse)
+    {
+        lastX = xpos;
+        lastY = ypos;
+        firstMouse = false;
+    }
+
+    mouseInput.yawOffset += (xpos - lastX) * MOUSE_SENSITIVITY;
+    mouseInput.pitchOffset += (lastY - ypos) * MOUSE_SENSITIVITY;
+
+    lastX = xpos;
+    lastY = ypos;
+}
+
+MipFilter parseMipFilter(const char *name)
+{
+    for (MipFilter filter : {MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos})
+    {
+        if (strcmp(name, mip_filter_name(filter)) == 0)
+            return filter;
+    }
+
+    cerr << "Unknown mip filter: " << name << endl;
+    return MipFilter::Kaiser;
+}
+
+Options parseOptions(int argc, char *argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--instanced") == 0)
+            options.renderMode = RenderMode::Instanced;
+        else if (strcmp(argv[i], "--per-draw") == 0)
+            options.renderMode = RenderMode::PerDraw;
+        else if (strcmp(argv[i], "--indirect") == 0)
+            options.renderMode = RenderMode::Indirect;
+        else if (strcmp(argv[i], "--no-cull") == 0)
+            options.cull = false;
+        else if (strcmp(argv[i], "--float-vertices") == 0)
+            options.compactVertices = false;
+        else if (strcmp(argv[i], "--rgba-textures") == 0)
+            options.compressTextures = false;
+        else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc)
+            options.mipFilter = parseMipFilter(argv[++i]);
+        else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+            options.meshPaths.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+            options.imagePaths.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--cubes") == 0 && i + 1 < argc)
+            options.cubeCount = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            options.frames = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            options.dumpDirectory = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0)
+            options.bench = true;
+        else if (strcmp(argv[i], "--profile") == 0)
+            options.profile = true;
+        else if (strcmp(argv[i], "--verify-transforms") == 0)
+            options.verifyTransforms = true;
+        else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+            options.benchOutput = argv[++i];
+        else
+            cerr << "Unknown argument: " << argv[i] << endl;
+    }
+
+    // headless and benchmark runs always end
+    // --frames counts measured frames, the warmup comes on top
+    if (options.bench)
+        options.frames = (options.frames > 0 ? options.frames : BENCH_DEFAULT_FRAMES) + BENCH_WARMUP_FRAMES;
+    else if (options.headless && options.frames == 0)
+        options.frames = 1;
+
+    return options;
 }
 
 int main(int argc, char *argv[])
 {
-    Application app;
+    Options options = parseOptions(argc, argv);
+
+    if (options.verifyTransforms)
+        return verify_model_matrices() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    Application app(options);
 
     try
     {
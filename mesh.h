@@ -0,0 +1,458 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "libs/glad.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "glstate.h"
+#include "util.h"
+#include "vertexformat.h"
+
+inline size_t index_size(GLenum type)
+{
+    return type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : type == GL_UNSIGNED_BYTE ? sizeof(uint8_t) : sizeof(uint32_t);
+}
+
+// simulated post-transform vertex cache for the Forsyth optimizer
+const int VERTEX_CACHE_SIZE = 32;
+
+struct Vertex
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+};
+
+// collects triangles and welds vertices whose attributes are bit-identical into an indexed mesh
+class MeshBuilder
+{
+  public:
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    // set by sources that provide normals, otherwise they stay zero and are left out of the vertex format
+    bool hasNormals = false;
+
+    uint32_t addVertex(const Vertex &vertex)
+    {
+        auto found = lookup.find(vertex);
+
+        if (found != lookup.end())
+            return found->second;
+
+        uint32_t index = vertices.size();
+        vertices.push_back(vertex);
+        lookup[vertex] = index;
+
+        return index;
+    }
+
+    void addTriangle(const Vertex &a, const Vertex &b, const Vertex &c)
+    {
+        indices.push_back(addVertex(a));
+        indices.push_back(addVertex(b));
+        indices.push_back(addVertex(c));
+    }
+
+    // expanded triangle list of position (3 floats) + uv (2 floats) vertices, as in cubeVertices
+    void addTriangles(const float *data, size_t vertexCount)
+    {
+        for (size_t i = 0; i + 2 < vertexCount; i += 3)
+        {
+            Vertex triangle[3];
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const float *v = data + (i + corner) * 5;
+                triangle[corner] = {glm::vec3(v[0], v[1], v[2]), glm::vec2(v[3], v[4]), glm::vec3(0.0f)};
+            }
+
+            addTriangle(triangle[0], triangle[1], triangle[2]);
+        }
+    }
+
+    // the most compact format that represents these vertices
+    VertexFormat compactFormat() const
+    {
+        float maxPosition = 0.0f;
+        bool uvsInUnitRange = true;
+
+        for (const Vertex &vertex : vertices)
+        {
+            glm::vec3 extent = glm::abs(vertex.position);
+            maxPosition = fmaxf(maxPosition, fmaxf(extent.x, fmaxf(extent.y, extent.z)));
+            uvsInUnitRange = uvsInUnitRange && vertex.uv.x >= 0.0f && vertex.uv.x <= 1.0f && vertex.uv.y >= 0.0f &&
+                             vertex.uv.y <= 1.0f;
+        }
+
+        return VertexFormat::compact(hasNormals, maxPosition, uvsInUnitRange);
+    }
+
+    // interleaved vertex data in the given format
+    std::vector<unsigned char> pack(const VertexFormat &format) const
+    {
+        std::vector<unsigned char> data(vertices.size() * format.stride);
+
+        for (size_t i = 0; i < vertices.size(); i++)
+            format.pack(vertices[i].position, vertices[i].uv, vertices[i].normal, &data[i * format.stride]);
+
+        return data;
+    }
+
+    // indices as bytes, 16 bit whenever they can address every vertex
+    std::vector<unsigned char> packIndices(GLenum &type) const
+    {
+        std::vector<unsigned char> data;
+
+        if (vertices.size() <= 65536)
+        {
+            type = GL_UNSIGNED_SHORT;
+            data.resize(indices.size() * sizeof(uint16_t));
+
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                uint16_t index = indices[i];
+                memcpy(&data[i * sizeof(uint16_t)], &index, sizeof(uint16_t));
+            }
+        }
+        else
+        {
+            type = GL_UNSIGNED_INT;
+            data.resize(indices.size() * sizeof(uint32_t));
+            memcpy(data.data(), indices.data(), data.size());
+        }
+
+        return data;
+    }
+
+    float radius() const
+    {
+        float longest = 0.0f;
+
+        for (const Vertex &vertex : vertices)
+            longest = fmaxf(longest, glm::length(vertex.position));
+
+        return longest;
+    }
+
+    // reorder triangles for the vertex cache, then vertices in order of first use for fetch locality
+    void optimize()
+    {
+        optimizeVertexCache(indices, vertices.size());
+        optimizeVertexFetch();
+    }
+
+  private:
+    struct VertexHash
+    {
+        size_t operator()(const Vertex &vertex) const
+        {
+            return hash_bytes(&vertex, sizeof(Vertex));
+        }
+    };
+
+    struct VertexEqual
+    {
+        bool operator()(const Vertex &a, const Vertex &b) const
+        {
+            return memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+
+    std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> lookup;
+
+    void optimizeVertexFetch()
+    {
+        std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+
+        for (uint32_t &index : indices)
+        {
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+
+            index = remap[index];
+        }
+
+        vertices.swap(ordered);
+        lookup.clear();
+    }
+
+    // Tom Forsyth's linear-speed vertex cache optimisation
+    //
+    // vertices score higher the more recently they were used and the fewer triangles
+    // still need them; the triangle with the best summed score is emitted next.
+    static void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+
+        if (triangleCount == 0)
+            return;
+
+        // triangles using each vertex, as offsets into one shared array
+        std::vector<uint32_t> valence(vertexCount, 0);
+
+        for (uint32_t index : indices)
+            valence[index]++;
+
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + valence[v];
+
+        std::vector<uint32_t> vertexTriangles(indices.size());
+        std::vector<uint32_t> filled(vertexCount, 0);
+
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t v = indices[t * 3 + corner];
+                vertexTriangles[offsets[v] + filled[v]++] = t;
+            }
+        }
+
+        std::vector<float> vertexScore(vertexCount);
+        std::vector<float> triangleScore(triangleCount, 0.0f);
+        std::vector<bool> emitted(triangleCount, false);
+
+        // valence now counts triangles not yet emitted
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = scoreVertex(-1, valence[v]);
+
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+                triangleScore[t] += vertexScore[indices[t * 3 + corner]];
+        }
+
+        std::vector<uint32_t> output;
+        output.reserve(indices.size());
+
+        int cache[VERTEX_CACHE_SIZE + 3];
+        int cacheCount = 0;
+
+        size_t scanCursor = 0;
+        int64_t best = -1;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            // no candidate from the cache, fall back to the next unemitted triangle in order
+            if (best < 0)
+            {
+                while (emitted[scanCursor])
+                    scanCursor++;
+
+                best = scanCursor;
+            }
+
+            uint32_t triangle = best;
+            emitted[triangle] = true;
+
+            int newCache[VERTEX_CACHE_SIZE + 3];
+            int newCount = 0;
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t v = indices[triangle * 3 + corner];
+                output.push_back(v);
+
+                newCache[newCount++] = v;
+                valence[v]--;
+
+                // drop the triangle from the vertex's remaining list
+                uint32_t *list = &vertexTriangles[offsets[v]];
+
+                for (uint32_t i = 0; i <= valence[v]; i++)
+                {
+                    if (list[i] == triangle)
+                    {
+                        list[i] = list[valence[v]];
+                        break;
+                    }
+                }
+            }
+
+            // the triangle's vertices move to the front, the rest shift back
+            for (int i = 0; i < cacheCount; i++)
+            {
+                int v = cache[i];
+
+                if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+                    newCache[newCount++] = v;
+            }
+
+            for (int i = 0; i < newCount; i++)
+                cache[i] = newCache[i];
+
+            cacheCount = newCount;
+
+            // rescore everything that was in the cache, including vertices falling out of it
+            for (int i = 0; i < cacheCount; i++)
+            {
+                uint32_t v = cache[i];
+                int position = i < VERTEX_CACHE_SIZE ? i : -1;
+
+                float score = scoreVertex(position, valence[v]);
+                float delta = score - vertexScore[v];
+                vertexScore[v] = score;
+
+                for (uint32_t j = 0; j < valence[v]; j++)
+                    triangleScore[vertexTriangles[offsets[v] + j]] += delta;
+            }
+
+            // only pick once every score is final, a triangle sharing several cached vertices
+            // gets a delta from each of them
+            best = -1;
+            float bestScore = -1.0f;
+
+            for (int i = 0; i < cacheCount; i++)
+            {
+                uint32_t v = cache[i];
+
+                for (uint32_t j = 0; j < valence[v]; j++)
+                {
+                    uint32_t t = vertexTriangles[offsets[v] + j];
+
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = t;
+                    }
+                }
+            }
+
+            if (cacheCount > VERTEX_CACHE_SIZE)
+                cacheCount = VERTEX_CACHE_SIZE;
+        }
+
+        indices.swap(output);
+    }
+
+    static float scoreVertex(int cachePosition, uint32_t remaining)
+    {
+        // nothing left to draw with this vertex
+        if (remaining == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+
+        if (cachePosition >= 0)
+        {
+            // the last triangle's vertices get a fixed score so strips don't dominate
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - (cachePosition - 3) / (float)(VERTEX_CACHE_SIZE - 3), 1.5f);
+        }
+
+        // boost vertices with few triangles left so they get finished off
+        return score + 2.0f / sqrtf((float)remaining);
+    }
+};
+
+// indexed mesh on the gpu, its vertices stored in the given format
+//
+// a mesh either owns its buffers or is a range of a MeshPool's shared ones, in which case
+// firstIndex and baseVertex locate it and the VAO belongs to the pool.
+class Mesh
+{
+  public:
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+
+    VertexFormat format;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    unsigned int firstIndex = 0;
+    int baseVertex = 0;
+    bool pooled = false;
+
+    // position within its pool, identifies the mesh in render queue sort keys
+    unsigned int id = 0;
+
+    // distance of the farthest vertex from the origin
+    float radius = 0.0f;
+
+    void create(const MeshBuilder &builder, const VertexFormat &vertexFormat)
+    {
+        std::vector<unsigned char> vertexData = builder.pack(vertexFormat);
+        std::vector<unsigned char> indexData = builder.packIndices(indexType);
+
+        allocate();
+        upload(vertexFormat, vertexData.data(), builder.vertices.size(), indexData.data(), builder.indices.size(),
+               indexType, builder.radius());
+    }
+
+    // generate the gl objects, the mesh draws nothing until upload() fills them
+    void allocate()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+    }
+
+    // fill the buffers with packed vertices and indices of indexType
+    void upload(const VertexFormat &vertexFormat, const void *vertices, unsigned int vertexTotal, const void *indices,
+                unsigned int indexTotal, GLenum type, float boundingRadius)
+    {
+        format = vertexFormat;
+        vertexCount = vertexTotal;
+        indexCount = indexTotal;
+        indexType = type;
+        radius = boundingRadius;
+
+        gl_state().bindVertexArray(VAO);
+
+        gl_state().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)vertexCount * format.stride, vertices, GL_STATIC_DRAW);
+
+        format.setup();
+
+        gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)indexCount * index_size(indexType), indices, GL_STATIC_DRAW);
+    }
+
+    void draw() const
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), baseVertex);
+    }
+
+    void drawInstanced(unsigned int instanceCount) const
+    {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), instanceCount,
+                                          baseVertex);
+    }
+
+    // the pool owns the gl objects of pooled meshes
+    void destroy()
+    {
+        if (pooled)
+            return;
+
+        gl_state().deleteVertexArrays(1, &VAO);
+        gl_state().deleteBuffers(1, &VBO);
+        gl_state().deleteBuffers(1, &EBO);
+    }
+
+  private:
+    void *indexOffset() const
+    {
+        return (void *)(firstIndex * index_size(indexType));
+    }
+};
+
+#endif
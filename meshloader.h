@@ -0,0 +1,1081 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include "libs/glad.h"
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "json.h"
+#include "mesh.h"
+#include "meshpool.h"
+#include "queue.h"
+#include "threadpool.h"
+#include "util.h"
+
+// imported meshes are kept here after welding, optimizing and packing, keyed by source file and format
+const char *const MESH_CACHE_DIRECTORY = "./cache/meshes";
+
+// bump when the importers or the packing change so stale cache files are rebuilt
+const uint32_t MESH_CACHE_VERSION = 1;
+
+const uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+
+const unsigned int MESH_CACHE_MAX_ATTRIBUTES = 8;
+
+// finished imports waiting for the gl thread
+const size_t MESH_QUEUE_CAPACITY = 64;
+
+// how a vertex attribute was packed, enough to rebuild the VertexFormat
+struct MeshCacheAttribute
+{
+    uint32_t semantic;
+    uint32_t location;
+    uint32_t type;
+    uint32_t components;
+};
+
+// header of a cached mesh file, the vertex and index data follow at the given offsets ready to upload
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexType;
+    uint32_t stride;
+
+    uint32_t attributeCount;
+    float radius;
+    MeshCacheAttribute attributes[MESH_CACHE_MAX_ATTRIBUTES];
+
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+};
+
+// decimal number at cursor, advancing past it
+//
+// mantissas up to 2^53 with small exponents are exact in a double, which covers what
+// exporters write; anything else goes through strtod.
+inline double parse_number(const char *&cursor, const char *end)
+{
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char *start = cursor;
+    bool negative = false;
+
+    if (cursor < end && (*cursor == '-' || *cursor == '+'))
+        negative = *cursor++ == '-';
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+
+    for (; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++, digits = true)
+    {
+        if (mantissa < 100000000000000000ull)
+            mantissa = mantissa * 10 + (*cursor - '0');
+        else
+            exponent++;
+    }
+
+    if (cursor < end && *cursor == '.')
+    {
+        for (cursor++; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++, digits = true)
+        {
+            if (mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*cursor - '0');
+                exponent--;
+            }
+        }
+    }
+
+    if (!digits)
+    {
+        cursor = start;
+        return 0.0;
+    }
+
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+    {
+        const char *mark = cursor++;
+        bool negativeExponent = false;
+
+        if (cursor < end && (*cursor == '-' || *cursor == '+'))
+            negativeExponent = *cursor++ == '-';
+
+        if (cursor == end || *cursor < '0' || *cursor > '9')
+        {
+            // not an exponent after all
+            cursor = mark;
+        }
+        else
+        {
+            int value = 0;
+
+            for (; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++)
+                value = value < 10000 ? value * 10 + (*cursor - '0') : value;
+
+            exponent += negativeExponent ? -value : value;
+        }
+    }
+
+    if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double value = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+        return negative ? -value : value;
+    }
+
+    char buffer[128];
+    size_t length = (size_t)(cursor - start) < sizeof(buffer) - 1 ? cursor - start : sizeof(buffer) - 1;
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    return strtod(buffer, NULL);
+}
+
+// Wavefront OBJ positions, texture coordinates, normals and polygon faces, everything else is skipped
+inline void parse_obj(const char *data, size_t size, MeshBuilder &builder)
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+
+    const char *cursor = data;
+    const char *end = data + size;
+    size_t line = 1;
+
+    auto skipSpaces = [&] {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+            cursor++;
+    };
+
+    auto fail = [&](const char *reason) {
+        throw std::runtime_error("Failed to parse obj line " + std::to_string(line) + ": " + reason);
+    };
+
+    // 1-based, negative counts back from the latest element
+    auto resolve = [&](long index, size_t count) -> long {
+        long resolved = index > 0 ? index - 1 : (long)count + index;
+
+        if (index == 0 || resolved < 0 || resolved >= (long)count)
+            fail("index out of range");
+
+        return resolved;
+    };
+
+    auto parseIndex = [&](long &value) -> bool {
+        const char *start = cursor;
+        bool negative = cursor < end && *cursor == '-';
+
+        if (negative)
+            cursor++;
+
+        value = 0;
+
+        while (cursor < end && *cursor >= '0' && *cursor <= '9')
+            value = value * 10 + (*cursor++ - '0');
+
+        if (negative)
+            value = -value;
+
+        return cursor != start;
+    };
+
+    std::vector<Vertex> polygon;
+
+    while (cursor < end)
+    {
+        skipSpaces();
+
+        const char *keyword = cursor;
+
+        while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r')
+            cursor++;
+
+        size_t keywordLength = cursor - keyword;
+
+        if (keywordLength == 1 && keyword[0] == 'v')
+        {
+            glm::vec3 position;
+
+            for (int i = 0; i < 3; i++)
+            {
+                skipSpaces();
+                position[i] = (float)parse_number(cursor, end);
+            }
+
+            positions.push_back(position);
+        }
+        else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 't')
+        {
+            glm::vec2 uv;
+
+            for (int i = 0; i < 2; i++)
+            {
+                skipSpaces();
+                uv[i] = (float)parse_number(cursor, end);
+            }
+
+            uvs.push_back(uv);
+        }
+        else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+        {
+            glm::vec3 normal;
+
+            for (int i = 0; i < 3; i++)
+            {
+                skipSpaces();
+                normal[i] = (float)parse_number(cursor, end);
+            }
+
+            normals.push_back(normal);
+        }
+        else if (keywordLength == 1 && keyword[0] == 'f')
+        {
+            polygon.clear();
+
+            while (true)
+            {
+                skipSpaces();
+
+                long position, uv = 0, normal = 0;
+
+                if (!parseIndex(position))
+                    break;
+
+                Vertex vertex = {positions[resolve(position, positions.size())], glm::vec2(0.0f), glm::vec3(0.0f)};
+
+                if (cursor < end && *cursor == '/')
+                {
+                    cursor++;
+
+                    if (parseIndex(uv))
+                        vertex.uv = uvs[resolve(uv, uvs.size())];
+
+                    if (cursor < end && *cursor == '/')
+                    {
+                        cursor++;
+
+                        if (parseIndex(normal))
+                        {
+                            vertex.normal = normals[resolve(normal, normals.size())];
+                            builder.hasNormals = true;
+                        }
+                    }
+                }
+
+                polygon.push_back(vertex);
+            }
+
+            if (polygon.size() < 3)
+                fail("face with fewer than three vertices");
+
+            // convex polygons become a fan around the first corner
+            for (size_t i = 1; i + 1 < polygon.size(); i++)
+                builder.addTriangle(polygon[0], polygon[i], polygon[i + 1]);
+        }
+
+        // ignore the rest of the line, including comments and unsupported statements
+        while (cursor < end && *cursor != '\n')
+            cursor++;
+
+        if (cursor < end)
+        {
+            cursor++;
+            line++;
+        }
+    }
+}
+
+// glTF 2.0 binary container, every triangle primitive of the default scene with node transforms applied
+class GlbImporter
+{
+  public:
+    static void parse(const char *data, size_t size, MeshBuilder &builder)
+    {
+        GlbImporter importer;
+        importer.read(data, size);
+        importer.build(builder);
+    }
+
+  private:
+    static const uint32_t GLB_MAGIC = 0x46546c67;      // "glTF"
+    static const uint32_t CHUNK_JSON = 0x4e4f534a;     // "JSON"
+    static const uint32_t CHUNK_BINARY = 0x004e4942;   // "BIN\0"
+
+    // node hierarchies nested deeper than this are treated as cyclic
+    static const int MAX_NODE_DEPTH = 64;
+
+    // the largest whole number a json double holds exactly, indices and sizes must be below it
+    static constexpr double MAX_NUMBER = 9007199254740992.0;
+
+    // vertex strides glTF allows, in steps of 4 bytes
+    static const size_t MIN_STRIDE = 4;
+    static const size_t MAX_STRIDE = 252;
+
+    JsonValue document;
+    const unsigned char *binary = NULL;
+    size_t binarySize = 0;
+
+    // typed view of an accessor inside the binary chunk, data is NULL for all-zero accessors
+    struct Accessor
+    {
+        const unsigned char *data;
+        size_t count;
+        size_t stride;
+        int componentType;
+        int components;
+        bool normalized;
+    };
+
+    void read(const char *data, size_t size)
+    {
+        uint32_t header[3];
+
+        if (size < sizeof(header))
+            throw std::runtime_error("Failed to parse glb: file too small");
+
+        memcpy(header, data, sizeof(header));
+
+        if (header[0] != GLB_MAGIC || header[1] != 2)
+            throw std::runtime_error("Failed to parse glb: not a glTF 2.0 binary");
+
+        size_t offset = sizeof(header);
+        size_t length = header[2] < size ? header[2] : size;
+        bool foundJson = false;
+
+        while (offset + 8 <= length)
+        {
+            uint32_t chunk[2];
+            memcpy(chunk, data + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+
+            if (chunk[0] > length - offset)
+                throw std::runtime_error("Failed to parse glb: truncated chunk");
+
+            if (chunk[1] == CHUNK_JSON && !foundJson)
+            {
+                document = JsonParser::parse(data + offset, chunk[0]);
+                foundJson = true;
+            }
+            else if (chunk[1] == CHUNK_BINARY && binary == NULL)
+            {
+                binary = (const unsigned char *)data + offset;
+                binarySize = chunk[0];
+            }
+
+            // chunks are padded to 4 bytes
+            offset += (chunk[0] + 3) & ~3u;
+        }
+
+        if (!foundJson)
+            throw std::runtime_error("Failed to parse glb: missing json chunk");
+    }
+
+    void build(MeshBuilder &builder)
+    {
+        const JsonValue *scenes = document.find("scenes");
+
+        // without scenes every mesh is drawn untransformed
+        if (scenes == NULL || scenes->items.empty())
+        {
+            const JsonValue *meshes = document.find("meshes");
+
+            for (size_t i = 0; meshes != NULL && i < meshes->items.size(); i++)
+                addMesh(meshes->items[i], glm::mat4(1.0f), builder);
+
+            return;
+        }
+
+        const JsonValue &scene = document.at("scenes", toSize(document.getNumber("scene", 0)));
+        const JsonValue *roots = scene.find("nodes");
+
+        for (size_t i = 0; roots != NULL && i < roots->items.size(); i++)
+            addNode(toSize(roots->items[i].number), glm::mat4(1.0f), 0, builder);
+    }
+
+    void addNode(size_t index, const glm::mat4 &parent, int depth, MeshBuilder &builder)
+    {
+        if (depth > MAX_NODE_DEPTH)
+            throw std::runtime_error("Failed to parse glb: node hierarchy too deep");
+
+        const JsonValue &node = document.at("nodes", index);
+        glm::mat4 transform = parent * localTransform(node);
+
+        const JsonValue *mesh = node.find("mesh");
+
+        if (mesh != NULL)
+            addMesh(document.at("meshes", toSize(mesh->number)), transform, builder);
+
+        const JsonValue *children = node.find("children");
+
+        for (size_t i = 0; children != NULL && i < children->items.size(); i++)
+            addNode(toSize(children->items[i].number), transform, depth + 1, builder);
+    }
+
+    // either a column major matrix or translation, rotation quaternion and scale
+    static glm::mat4 localTransform(const JsonValue &node)
+    {
+        glm::mat4 transform(1.0f);
+        const JsonValue *matrix = node.find("matrix");
+
+        if (matrix != NULL && matrix->items.size() == 16)
+        {
+            for (int i = 0; i < 16; i++)
+                transform[i / 4][i % 4] = (float)matrix->items[i].number;
+
+            return transform;
+        }
+
+        float translation[3] = {0.0f, 0.0f, 0.0f};
+        float rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+        float scale[3] = {1.0f, 1.0f, 1.0f};
+
+        readFloats(node.find("translation"), translation, 3);
+        readFloats(node.find("rotation"), rotation, 4);
+        readFloats(node.find("scale"), scale, 3);
+
+        float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+
+        glm::vec3 columns[3] = {
+            glm::vec3(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w)),
+            glm::vec3(2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w)),
+            glm::vec3(2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y)),
+        };
+
+        for (int i = 0; i < 3; i++)
+            transform[i] = glm::vec4(columns[i] * scale[i], 0.0f);
+
+        transform[3] = glm::vec4(translation[0], translation[1], translation[2], 1.0f);
+
+        return transform;
+    }
+
+    static void readFloats(const JsonValue *array, float *out, size_t count)
+    {
+        for (size_t i = 0; array != NULL && i < count && i < array->items.size(); i++)
+            out[i] = (float)array->items[i].number;
+    }
+
+    void addMesh(const JsonValue &mesh, const glm::mat4 &transform, MeshBuilder &builder)
+    {
+        // normals use the cofactor matrix, which handles non-uniform scale without an inverse
+        glm::vec3 axes[3] = {glm::vec3(transform[0]), glm::vec3(transform[1]), glm::vec3(transform[2])};
+        glm::vec3 cofactors[3] = {glm::cross(axes[1], axes[2]), glm::cross(axes[2], axes[0]),
+                                  glm::cross(axes[0], axes[1])};
+
+        const JsonValue *primitives = mesh.find("primitives");
+
+        for (size_t p = 0; primitives != NULL && p < primitives->items.size(); p++)
+        {
+            const JsonValue &primitive = primitives->items[p];
+
+            // only triangle lists, points, lines and strips are skipped
+            if (primitive.getNumber("mode", 4) != 4)
+                continue;
+
+            const JsonValue *attributes = primitive.find("attributes");
+            const JsonValue *position = attributes != NULL ? attributes->find("POSITION") : NULL;
+
+            if (position == NULL)
+                continue;
+
+            std::vector<float> positions = readFloats(accessor(toSize(position->number)), 3);
+            size_t vertexCount = positions.size() / 3;
+
+            std::vector<float> uvs, normals;
+            const JsonValue *uv = attributes->find("TEXCOORD_0");
+            const JsonValue *normal = attributes->find("NORMAL");
+
+            if (uv != NULL)
+                uvs = readFloats(accessor(toSize(uv->number)), 2);
+
+            if (normal != NULL)
+            {
+                normals = readFloats(accessor(toSize(normal->number)), 3);
+                builder.hasNormals = true;
+            }
+
+            std::vector<Vertex> vertices(vertexCount);
+
+            for (size_t i = 0; i < vertexCount; i++)
+            {
+                Vertex &vertex = vertices[i];
+                vertex.position = glm::vec3(transform * glm::vec4(positions[i * 3], positions[i * 3 + 1],
+                                                                  positions[i * 3 + 2], 1.0f));
+                vertex.uv = glm::vec2(0.0f);
+                vertex.normal = glm::vec3(0.0f);
+
+                // glTF puts the texture origin top left, the textures here are flipped on load
+                if (i * 2 + 1 < uvs.size())
+                    vertex.uv = glm::vec2(uvs[i * 2], 1.0f - uvs[i * 2 + 1]);
+
+                if (i * 3 + 2 < normals.size())
+                {
+                    glm::vec3 n = cofactors[0] * normals[i * 3] + cofactors[1] * normals[i * 3 + 1] +
+                                  cofactors[2] * normals[i * 3 + 2];
+                    float length = glm::length(n);
+
+                    if (length > 0.0f)
+                        vertex.normal = n / length;
+                }
+            }
+
+            const JsonValue *indices = primitive.find("indices");
+            std::vector<uint32_t> corners;
+
+            if (indices != NULL)
+            {
+                corners = readIndices(accessor(toSize(indices->number)));
+            }
+            else
+            {
+                corners.resize(vertexCount);
+
+                for (size_t i = 0; i < vertexCount; i++)
+                    corners[i] = i;
+            }
+
+            for (size_t i = 0; i + 2 < corners.size(); i += 3)
+            {
+                if (corners[i] >= vertexCount || corners[i + 1] >= vertexCount || corners[i + 2] >= vertexCount)
+                    throw std::runtime_error("Failed to parse glb: index out of range");
+
+                builder.addTriangle(vertices[corners[i]], vertices[corners[i + 1]], vertices[corners[i + 2]]);
+            }
+        }
+    }
+
+    Accessor accessor(size_t index)
+    {
+        const JsonValue &json = document.at("accessors", index);
+
+        if (json.find("sparse") != NULL)
+            throw std::runtime_error("Failed to parse glb: sparse accessors are not supported");
+
+        Accessor result;
+        result.count = toSize(json.getNumber("count", 0));
+        result.componentType = (int)json.getNumber("componentType", 5126);
+        result.normalized = json.getBool("normalized", false);
+        result.data = NULL;
+
+        const JsonValue *type = json.find("type");
+        std::string name = type != NULL ? type->string : "";
+
+        if (name == "SCALAR")
+            result.components = 1;
+        else if (name == "VEC2" || name == "VEC3" || name == "VEC4")
+            result.components = name[3] - '0';
+        else
+            throw std::runtime_error("Failed to parse glb: unsupported accessor type " + name);
+
+        size_t elementSize = componentSize(result.componentType) * result.components;
+        result.stride = elementSize;
+
+        const JsonValue *view = json.find("bufferView");
+
+        if (view == NULL || result.count == 0)
+            return result;
+
+        const JsonValue &bufferView = document.at("bufferViews", toSize(view->number));
+
+        if (bufferView.getNumber("buffer", 0) != 0 || binary == NULL)
+            throw std::runtime_error("Failed to parse glb: only the embedded binary buffer is supported");
+
+        size_t viewOffset = toSize(bufferView.getNumber("byteOffset", 0));
+        size_t viewLength = toSize(bufferView.getNumber("byteLength", 0));
+        size_t offset = toSize(json.getNumber("byteOffset", 0));
+        result.stride = toSize(bufferView.getNumber("byteStride", elementSize));
+
+        if (bufferView.find("byteStride") != NULL &&
+            (result.stride < MIN_STRIDE || result.stride > MAX_STRIDE || result.stride % 4 != 0))
+            throw std::runtime_error("Failed to parse glb: invalid byte stride " + std::to_string(result.stride));
+
+        bool inside = viewOffset <= binarySize && viewLength <= binarySize - viewOffset && offset <= viewLength &&
+                      result.stride >= elementSize && result.count <= viewLength &&
+                      (result.count - 1) * result.stride + elementSize <= viewLength - offset;
+
+        if (!inside)
+            throw std::runtime_error("Failed to parse glb: accessor outside of its buffer");
+
+        result.data = binary + viewOffset + offset;
+
+        return result;
+    }
+
+    // a json number used as an index, count or byte offset, which has to be a whole number that size_t holds
+    static size_t toSize(double value)
+    {
+        if (!(value >= 0.0 && value <= MAX_NUMBER) || value != floor(value))
+            throw std::runtime_error("Failed to parse glb: " + std::to_string(value) + " is not a valid index");
+
+        return (size_t)value;
+    }
+
+    static size_t componentSize(int componentType)
+    {
+        switch (componentType)
+        {
+        case 5120: // byte
+        case 5121: // unsigned byte
+            return 1;
+        case 5122: // short
+        case 5123: // unsigned short
+            return 2;
+        case 5125: // unsigned int
+        case 5126: // float
+            return 4;
+        }
+
+        throw std::runtime_error("Failed to parse glb: unknown component type " + std::to_string(componentType));
+    }
+
+    // components of every element as floats, normalized integers mapped to [0, 1] or [-1, 1]
+    static std::vector<float> readFloats(const Accessor &source, int components)
+    {
+        std::vector<float> values(source.count * components, 0.0f);
+
+        if (source.data == NULL)
+            return values;
+
+        int count = source.components < components ? source.components : components;
+
+        for (size_t i = 0; i < source.count; i++)
+        {
+            const unsigned char *element = source.data + i * source.stride;
+
+            for (int c = 0; c < count; c++)
+                values[i * components + c] = readComponent(element, c, source.componentType, source.normalized);
+        }
+
+        return values;
+    }
+
+    static float readComponent(const unsigned char *element, int component, int componentType, bool normalized)
+    {
+        switch (componentType)
+        {
+        case 5120:
+        {
+            int8_t value = (int8_t)element[component];
+            return normalized ? fmaxf(value / 127.0f, -1.0f) : value;
+        }
+        case 5121:
+            return normalized ? element[component] / 255.0f : element[component];
+        case 5122:
+        {
+            int16_t value;
+            memcpy(&value, element + component * 2, 2);
+            return normalized ? fmaxf(value / 32767.0f, -1.0f) : value;
+        }
+        case 5123:
+        {
+            uint16_t value;
+            memcpy(&value, element + component * 2, 2);
+            return normalized ? value / 65535.0f : value;
+        }
+        case 5125:
+        {
+            uint32_t value;
+            memcpy(&value, element + component * 4, 4);
+            return (float)value;
+        }
+        default:
+        {
+            float value;
+            memcpy(&value, element + component * 4, 4);
+            return value;
+        }
+        }
+    }
+
+    static std::vector<uint32_t> readIndices(const Accessor &source)
+    {
+        if (source.components != 1 || source.data == NULL ||
+            (source.componentType != 5121 && source.componentType != 5123 && source.componentType != 5125))
+            throw std::runtime_error("Failed to parse glb: invalid index accessor");
+
+        std::vector<uint32_t> indices(source.count);
+
+        for (size_t i = 0; i < source.count; i++)
+        {
+            const unsigned char *element = source.data + i * source.stride;
+
+            if (source.componentType == 5121)
+            {
+                indices[i] = element[0];
+            }
+            else if (source.componentType == 5123)
+            {
+                uint16_t value;
+                memcpy(&value, element, 2);
+                indices[i] = value;
+            }
+            else
+            {
+                memcpy(&indices[i], element, 4);
+            }
+        }
+
+        return indices;
+    }
+};
+
+// imports OBJ and GLB meshes without blocking the render loop
+//
+// load() hands back a mesh straight away that draws nothing until it's ready. workers parse
+// the source, weld, optimize and pack it, then store the result in the mesh cache. later
+// launches skip all of that: the cache file is mapped and its bytes go to glBufferData as is.
+// given a MeshPool, every mesh is packed in the pool's format and becomes a range of it.
+class MeshLoader
+{
+  public:
+    MeshLoader() : loaded(MESH_QUEUE_CAPACITY)
+    {
+    }
+
+    // compact selects VertexFormat::compact over the full float layout for meshes with their own buffers
+    void create(bool compact, MeshPool *meshPool = NULL)
+    {
+        compactVertices = compact;
+        target = meshPool;
+
+        // cache files are only valid for the format they were packed in
+        formatKey = compact;
+
+        if (target != NULL)
+        {
+            for (const VertexAttribute &attribute : target->format.attributes)
+            {
+                uint32_t description[4] = {(uint32_t)attribute.semantic, attribute.location, (uint32_t)attribute.type,
+                                           (uint32_t)attribute.components};
+                formatKey = hash_bytes(description, sizeof(description), formatKey);
+            }
+        }
+
+        unsigned int threads = std::thread::hardware_concurrency();
+        pool.create(threads > 1 ? threads - 1 : 1);
+    }
+
+    Mesh *load(const std::string &path)
+    {
+        meshes.emplace_back();
+        Mesh *mesh = &meshes.back();
+
+        if (target == NULL)
+            mesh->allocate();
+
+        pending++;
+        pool.submit([this, path, mesh] { import(path, mesh); });
+
+        return mesh;
+    }
+
+    // upload meshes that finished importing, returns how many did; call on the gl thread
+    unsigned int update()
+    {
+        LoadedMesh *result;
+        unsigned int count = 0;
+
+        while (loaded.pop(result))
+        {
+            upload(result);
+            count++;
+        }
+
+        return count;
+    }
+
+    // block until every requested mesh is uploaded
+    void finish()
+    {
+        LoadedMesh *result;
+
+        while (pending > 0)
+        {
+            if (loaded.pop(result))
+                upload(result);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    void destroy()
+    {
+        // nothing drains the queue anymore, workers drop their results rather than wait for room
+        stopping = true;
+        pool.destroy();
+
+        LoadedMesh *result;
+
+        while (loaded.pop(result))
+            delete result;
+
+        for (Mesh &mesh : meshes)
+            mesh.destroy();
+
+        meshes.clear();
+    }
+
+  private:
+    // either a mapped cache file or freshly packed buffers, handed from a worker to the gl thread
+    struct LoadedMesh
+    {
+        Mesh *mesh;
+        bool valid = false;
+
+        MappedFile file;
+        std::vector<unsigned char> vertexData;
+        std::vector<unsigned char> indexData;
+
+        VertexFormat format;
+        const void *vertices = NULL;
+        const void *indices = NULL;
+        unsigned int vertexCount = 0;
+        unsigned int indexCount = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        float radius = 0.0f;
+    };
+
+    ThreadPool pool;
+    ConcurrentQueue<LoadedMesh *> loaded;
+    std::atomic<unsigned int> pending{0};
+    std::atomic<bool> stopping{false};
+
+    // deque so handed out pointers stay valid as more meshes load
+    std::deque<Mesh> meshes;
+    bool compactVertices = true;
+    MeshPool *target = NULL;
+    uint64_t formatKey = 0;
+
+    // worker side
+    void import(const std::string &path, Mesh *mesh)
+    {
+        // imports still queued at shutdown aren't worth finishing
+        if (stopping)
+            return;
+
+        LoadedMesh *result = new LoadedMesh();
+        result->mesh = mesh;
+
+        try
+        {
+            uint64_t key = cacheKey(path);
+
+            if (!loadCache(key, *result))
+            {
+                parse(path, *result);
+                saveCache(key, *result);
+            }
+
+            result->valid = true;
+        }
+        catch (std::runtime_error &e)
+        {
+            std::cout << "Failed to load mesh: " << e.what() << std::endl;
+        }
+
+        while (!loaded.push(result))
+        {
+            if (stopping)
+            {
+                delete result;
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    void parse(const std::string &path, LoadedMesh &result)
+    {
+        MeshBuilder builder;
+
+        {
+            MappedFile file(path);
+
+            if (hasSuffix(path, ".glb"))
+                GlbImporter::parse(file.data(), file.size(), builder);
+            else if (hasSuffix(path, ".obj"))
+                parse_obj(file.data(), file.size(), builder);
+            else
+                throw std::runtime_error("Unsupported mesh format " + path);
+        }
+
+        builder.optimize();
+
+        if (target != NULL)
+            result.format = target->format;
+        else if (compactVertices)
+            result.format = builder.compactFormat();
+        else
+            result.format = VertexFormat::full(builder.hasNormals);
+        result.vertexData = builder.pack(result.format);
+        result.indexData = builder.packIndices(result.indexType);
+
+        result.vertices = result.vertexData.data();
+        result.indices = result.indexData.data();
+        result.vertexCount = builder.vertices.size();
+        result.indexCount = builder.indices.size();
+        result.radius = builder.radius();
+    }
+
+    void upload(LoadedMesh *result)
+    {
+        pending--;
+
+        if (result->valid && target != NULL)
+        {
+            target->add(*result->mesh, result->vertices, result->vertexCount, result->indices, result->indexCount,
+                        result->indexType, result->radius);
+        }
+        else if (result->valid)
+        {
+            result->mesh->upload(result->format, result->vertices, result->vertexCount, result->indices,
+                                 result->indexCount, result->indexType, result->radius);
+        }
+
+        delete result;
+    }
+
+    static bool hasSuffix(const std::string &value, const char *suffix)
+    {
+        size_t length = strlen(suffix);
+
+        if (value.size() < length)
+            return false;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            if (tolower(value[value.size() - length + i]) != suffix[i])
+                return false;
+        }
+
+        return true;
+    }
+
+    // the source is identified by path, size and modification time rather than hashing its contents
+    uint64_t cacheKey(const std::string &path) const
+    {
+        uint64_t key = hash_bytes(&formatKey, sizeof(formatKey));
+
+        if (!hash_file_identity(path, key))
+            throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+
+        return hash_bytes(&MESH_CACHE_VERSION, sizeof(MESH_CACHE_VERSION), key);
+    }
+
+    static std::string cachePath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.mesh", (unsigned long long)key);
+
+        return MESH_CACHE_DIRECTORY + std::string(name);
+    }
+
+    // returns false when there is no usable cache file
+    bool loadCache(uint64_t key, LoadedMesh &result)
+    {
+        try
+        {
+            result.file = MappedFile(cachePath(key));
+        }
+        catch (std::runtime_error &)
+        {
+            return false;
+        }
+
+        const char *data = result.file.data();
+        size_t size = result.file.size();
+
+        MeshCacheHeader header;
+
+        if (size < sizeof(header))
+            return false;
+
+        memcpy(&header, data, sizeof(header));
+
+        if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.key != key ||
+            header.attributeCount > MESH_CACHE_MAX_ATTRIBUTES)
+            return false;
+
+        // index_size reads any other type as 32 bit, and the draw call would reject it
+        if (header.indexType != GL_UNSIGNED_BYTE && header.indexType != GL_UNSIGNED_SHORT &&
+            header.indexType != GL_UNSIGNED_INT)
+            return false;
+
+        for (uint32_t i = 0; i < header.attributeCount; i++)
+        {
+            const MeshCacheAttribute &attribute = header.attributes[i];
+            result.format.add((VertexSemantic)attribute.semantic, attribute.location, (AttributeType)attribute.type,
+                              attribute.components);
+        }
+
+        size_t vertexBytes = (size_t)header.vertexCount * header.stride;
+        size_t indexBytes = (size_t)header.indexCount * index_size(header.indexType);
+
+        if (result.format.stride != header.stride || header.vertexOffset > size ||
+            vertexBytes > size - header.vertexOffset || header.indexOffset > size ||
+            indexBytes > size - header.indexOffset)
+            return false;
+
+        result.vertices = data + header.vertexOffset;
+        result.indices = data + header.indexOffset;
+        result.vertexCount = header.vertexCount;
+        result.indexCount = header.indexCount;
+        result.indexType = header.indexType;
+        result.radius = header.radius;
+
+        return true;
+    }
+
+    void saveCache(uint64_t key, const LoadedMesh &result)
+    {
+        if (!make_directories(MESH_CACHE_DIRECTORY) || result.format.attributes.size() > MESH_CACHE_MAX_ATTRIBUTES)
+            return;
+
+        MeshCacheHeader header = {};
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.key = key;
+        header.vertexCount = result.vertexCount;
+        header.indexCount = result.indexCount;
+        header.indexType = result.indexType;
+        header.stride = result.format.stride;
+        header.attributeCount = result.format.attributes.size();
+        header.radius = result.radius;
+
+        for (uint32_t i = 0; i < header.attributeCount; i++)
+        {
+            const VertexAttribute &attribute = result.format.attributes[i];
+            header.attributes[i] = {(uint32_t)attribute.semantic, attribute.location, (uint32_t)attribute.type,
+                                    (uint32_t)attribute.components};
+        }
+
+        // keep both blocks 16 byte aligned in the mapping
+        header.vertexOffset = cache_block_offset(sizeof(header));
+        header.indexOffset = cache_block_offset(header.vertexOffset + result.vertexData.size());
+
+        write_cache_file(cachePath(key), {{0, &header, sizeof(header)},
+                                          {header.vertexOffset, result.vertexData.data(), result.vertexData.size()},
+                                          {header.indexOffset, result.indexData.data(), result.indexData.size()}});
+    }
+};
+
+#endif
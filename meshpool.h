@@ -0,0 +1,170 @@
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+
+#include "libs/glad.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "glstate.h"
+#include "mesh.h"
+#include "vertexformat.h"
+
+// meshes sharing one vertex buffer, one 32 bit index buffer and one VAO
+//
+// drawing different pooled meshes needs no rebinding, only another first index and base
+// vertex, which is what lets a multi-draw cover all of them in one call. buffers grow by
+// doubling and copying on the gpu when a mesh doesn't fit.
+class MeshPool
+{
+  public:
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+
+    VertexFormat format;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    unsigned int meshCount = 0;
+
+    void create(const VertexFormat &vertexFormat, unsigned int vertexCapacity, unsigned int indexCapacity)
+    {
+        format = vertexFormat;
+        vertexCapacity = vertexCapacity > 0 ? vertexCapacity : 1;
+        indexCapacity = indexCapacity > 0 ? indexCapacity : 1;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        gl_state().bindVertexArray(VAO);
+
+        gl_state().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)vertexCapacity * format.stride, NULL, GL_STATIC_DRAW);
+
+        gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)indexCapacity * sizeof(uint32_t), NULL, GL_STATIC_DRAW);
+
+        format.setup();
+
+        vertexLimit = vertexCapacity;
+        indexLimit = indexCapacity;
+    }
+
+    // append vertices packed in the pool's format and indices of any type, the mesh becomes a range of the pool
+    void add(Mesh &mesh, const void *vertices, unsigned int vertexTotal, const void *indices, unsigned int indexTotal,
+             GLenum indexType, float radius)
+    {
+        reserve(vertexCount + vertexTotal, indexCount + indexTotal);
+
+        // the pool draws everything with 32 bit indices
+        std::vector<uint32_t> wide;
+
+        if (indexType != GL_UNSIGNED_INT)
+        {
+            wide.resize(indexTotal);
+
+            for (unsigned int i = 0; i < indexTotal; i++)
+            {
+                if (indexType == GL_UNSIGNED_SHORT)
+                {
+                    uint16_t index;
+                    memcpy(&index, (const char *)indices + i * sizeof(uint16_t), sizeof(uint16_t));
+                    wide[i] = index;
+                }
+                else
+                {
+                    wide[i] = ((const uint8_t *)indices)[i];
+                }
+            }
+
+            indices = wide.data();
+        }
+
+        // through the copy target so the element buffer of whatever VAO is bound stays untouched
+        gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)vertexCount * format.stride,
+                        (size_t)vertexTotal * format.stride, vertices);
+
+        gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)indexCount * sizeof(uint32_t),
+                        (size_t)indexTotal * sizeof(uint32_t), indices);
+
+        // the buffers are replaced when the pool grows, so only the VAO is shared
+        mesh.VAO = VAO;
+        mesh.VBO = 0;
+        mesh.EBO = 0;
+        mesh.format = format;
+        mesh.vertexCount = vertexTotal;
+        mesh.indexCount = indexTotal;
+        mesh.indexType = GL_UNSIGNED_INT;
+        mesh.firstIndex = indexCount;
+        mesh.baseVertex = vertexCount;
+        mesh.pooled = true;
+        mesh.id = meshCount++;
+        mesh.radius = radius;
+
+        vertexCount += vertexTotal;
+        indexCount += indexTotal;
+    }
+
+    void add(Mesh &mesh, const MeshBuilder &builder)
+    {
+        std::vector<unsigned char> vertices = builder.pack(format);
+
+        add(mesh, vertices.data(), builder.vertices.size(), builder.indices.data(), builder.indices.size(),
+            GL_UNSIGNED_INT, builder.radius());
+    }
+
+    void destroy()
+    {
+        gl_state().deleteVertexArrays(1, &VAO);
+        gl_state().deleteBuffers(1, &VBO);
+        gl_state().deleteBuffers(1, &EBO);
+    }
+
+  private:
+    unsigned int vertexLimit = 0;
+    unsigned int indexLimit = 0;
+
+    void reserve(unsigned int vertices, unsigned int indices)
+    {
+        if (vertices <= vertexLimit && indices <= indexLimit)
+            return;
+
+        while (vertexLimit < vertices)
+            vertexLimit *= 2;
+
+        while (indexLimit < indices)
+            indexLimit *= 2;
+
+        grow(VBO, (size_t)vertexCount * format.stride, (size_t)vertexLimit * format.stride);
+        grow(EBO, (size_t)indexCount * sizeof(uint32_t), (size_t)indexLimit * sizeof(uint32_t));
+
+        // the VAO still points at the old buffers
+        gl_state().bindVertexArray(VAO);
+
+        gl_state().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        format.setup();
+
+        gl_state().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    }
+
+    // replace buffer with a larger one holding the same first used bytes
+    static void grow(unsigned int &buffer, size_t used, size_t capacity)
+    {
+        unsigned int larger;
+        glGenBuffers(1, &larger);
+
+        gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, larger);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+
+        gl_state().bindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+
+        gl_state().deleteBuffers(1, &buffer);
+        buffer = larger;
+    }
+};
+
+#endif
@@ -0,0 +1,401 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "threadpool.h"
+#include "util.h"
+
+// lobes of the windowed sinc filters on each side, in destination texels
+const float MIP_FILTER_WIDTH = 3.0f;
+
+// shape of the Kaiser window, higher is smoother with less ringing
+const float MIP_KAISER_ALPHA = 4.0f;
+
+// rows of a level converted or filtered per job
+const size_t MIP_ROWS_PER_JOB = 16;
+
+// entries of the table encoding linear values back to sRGB
+const int MIP_SRGB_TABLE_SIZE = 4096;
+
+enum class MipFilter
+{
+    // average of each 2x2 footprint, what glGenerateMipmap does
+    Box,
+    // sinc under a Kaiser window, sharp with little ringing
+    Kaiser,
+    // sinc under a wider sinc, a little sharper than Kaiser and rings a little more
+    Lanczos
+};
+
+inline const char *mip_filter_name(MipFilter filter)
+{
+    switch (filter)
+    {
+    case MipFilter::Box:
+        return "box";
+    case MipFilter::Kaiser:
+        return "kaiser";
+    case MipFilter::Lanczos:
+        return "lanczos";
+    }
+
+    return "unknown";
+}
+
+// number of levels of a full chain down to 1x1
+inline int mip_level_count(int width, int height)
+{
+    int count = 1;
+
+    while ((width >> count) > 0 || (height >> count) > 0)
+        count++;
+
+    return count;
+}
+
+// which source texels make up each destination texel along one axis, and how much each counts
+struct MipKernel
+{
+    int taps = 0;
+
+    // taps entries per destination texel, indices already clamped to the source
+    std::vector<int> indices;
+    std::vector<float> weights;
+};
+
+// builds mip chains on the cpu with a choice of filter
+//
+// color is filtered in linear light, so averaged colors keep their brightness instead of darkening
+// as they do when sRGB values are averaged directly. alpha isn't premultiplied, the shader shows
+// the color of transparent texels too. each level is two separable passes over RGBA float texels,
+// four channels to an SSE register, with rows spread over the pool when one is given. levels depend
+// on the one before, so they're built in turn.
+class MipBuilder
+{
+  public:
+    MipFilter filter = MipFilter::Kaiser;
+
+    // treat color as sRGB encoded, alpha is always linear
+    bool srgb = true;
+
+    // rows of each pass are spread over this pool, or done on the calling thread without one
+    ThreadPool *pool = NULL;
+
+    // call output(level, pixels, width, height) for levels 0 to levelCount - 1 of an RGBA8 image,
+    // pixels are only valid during the call
+    template <typename F>
+    void build(const unsigned char *pixels, int width, int height, int levelCount, const F &output)
+    {
+        output(0, pixels, width, height);
+
+        if (levelCount < 2)
+            return;
+
+        current.resize((size_t)width * height * 4);
+        decode(pixels, width, height);
+
+        for (int level = 1; level < levelCount; level++)
+        {
+            int nextWidth = std::max(width / 2, 1);
+            int nextHeight = std::max(height / 2, 1);
+
+            downsample(width, height, nextWidth, nextHeight);
+            current.swap(next);
+
+            width = nextWidth;
+            height = nextHeight;
+
+            encoded.resize((size_t)width * height * 4);
+            encode(width, height);
+
+            output(level, encoded.data(), width, height);
+        }
+    }
+
+  private:
+    typedef std::vector<float, AlignedAllocator<float, 16>> TexelArray;
+
+    // the level being filtered, the horizontal pass's output and the next level, RGBA floats
+    TexelArray current;
+    TexelArray horizontal;
+    TexelArray next;
+    std::vector<unsigned char> encoded;
+
+    MipKernel columns;
+    MipKernel rows;
+
+    // sRGB to linear for each 8 bit value, and linear to 8 bit sRGB in MIP_SRGB_TABLE_SIZE steps
+    struct SrgbTables
+    {
+        float toLinear[256];
+        unsigned char toSrgb[MIP_SRGB_TABLE_SIZE];
+
+        SrgbTables()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                float value = i / 255.0f;
+                toLinear[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+            }
+
+            for (int i = 0; i < MIP_SRGB_TABLE_SIZE; i++)
+            {
+                float value = i / (float)(MIP_SRGB_TABLE_SIZE - 1);
+                float encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+                toSrgb[i] = (unsigned char)(encoded * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    static const SrgbTables &srgbTables()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    void forRows(int height, const std::function<void(size_t, size_t)> &function)
+    {
+        parallel_for(pool, height, MIP_ROWS_PER_JOB, function);
+    }
+
+    // RGBA8 into linear floats in current
+    void decode(const unsigned char *pixels, int width, int height)
+    {
+        const SrgbTables &tables = srgbTables();
+
+        forRows(height, [this, &tables, pixels, width](size_t begin, size_t end) {
+            for (size_t i = begin * width; i < end * width; i++)
+            {
+                const unsigned char *source = &pixels[i * 4];
+                float *texel = &current[i * 4];
+                for (int channel = 0; channel < 3; channel++)
+                    texel[channel] = srgb ? tables.toLinear[source[channel]] : source[channel] / 255.0f;
+
+                texel[3] = source[3] / 255.0f;
+            }
+        });
+    }
+
+    // current back to RGBA8 in encoded, negative lobes can push values out of range so they're clamped
+    void encode(int width, int height)
+    {
+        const SrgbTables &tables = srgbTables();
+
+        forRows(height, [this, &tables, width](size_t begin, size_t end) {
+            for (size_t i = begin * width; i < end * width; i++)
+            {
+                const float *texel = &current[i * 4];
+                unsigned char *destination = &encoded[i * 4];
+                for (int channel = 0; channel < 4; channel++)
+                {
+                    float value = std::min(std::max(texel[channel], 0.0f), 1.0f);
+
+                    if (srgb && channel < 3)
+                        destination[channel] = tables.toSrgb[(int)(value * (MIP_SRGB_TABLE_SIZE - 1) + 0.5f)];
+                    else
+                        destination[channel] = (unsigned char)(value * 255.0f + 0.5f);
+                }
+            }
+        });
+    }
+
+    // current at width x height into next at the destination size, columns first
+    void downsample(int width, int height, int nextWidth, int nextHeight)
+    {
+        makeKernel(width, nextWidth, columns);
+        makeKernel(height, nextHeight, rows);
+
+        horizontal.resize((size_t)nextWidth * height * 4);
+        next.resize((size_t)nextWidth * nextHeight * 4);
+
+        forRows(height, [this, width, nextWidth](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++)
+            {
+                filterRow(&current[y * width * 4], nextWidth, &horizontal[y * nextWidth * 4]);
+            }
+        });
+
+        // each destination row sums whole source rows, which streams through memory in order
+        forRows(nextHeight, [this, nextWidth](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; y++)
+            {
+                const int *indices = &rows.indices[y * rows.taps];
+                const float *weights = &rows.weights[y * rows.taps];
+
+                sumRows(indices, weights, rows.taps, nextWidth, &next[y * nextWidth * 4]);
+            }
+        });
+    }
+
+    // the filter at x destination texels from a sample's center
+    float weight(float x) const
+    {
+        x = fabsf(x);
+
+        if (filter == MipFilter::Box)
+            return x <= 0.5f ? 1.0f : 0.0f;
+
+        if (x >= MIP_FILTER_WIDTH)
+            return 0.0f;
+
+        float window;
+
+        if (filter == MipFilter::Lanczos)
+        {
+            window = sinc(x / MIP_FILTER_WIDTH);
+        }
+        else
+        {
+            float ratio = x / MIP_FILTER_WIDTH;
+            window = bessel0(MIP_KAISER_ALPHA * sqrtf(1.0f - ratio * ratio)) / bessel0(MIP_KAISER_ALPHA);
+        }
+
+        return sinc(x) * window;
+    }
+
+    static float sinc(float x)
+    {
+        if (x == 0.0f)
+            return 1.0f;
+
+        float angle = (float)M_PI * x;
+        return sinf(angle) / angle;
+    }
+
+    // modified Bessel function of the first kind, order zero, by its power series
+    static float bessel0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        float quarter = x * x / 4.0f;
+
+        for (int k = 1; k < 32 && term > sum * 1e-8f; k++)
+        {
+            term *= quarter / (k * k);
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    // weights of a source to destination resampling along one axis, each destination texel's sum to one
+    void makeKernel(int sourceSize, int destinationSize, MipKernel &kernel) const
+    {
+        float scale = (float)sourceSize / destinationSize;
+        float support = (filter == MipFilter::Box ? 0.5f : MIP_FILTER_WIDTH) * scale;
+
+        kernel.taps = (int)ceilf(support * 2.0f) + 1;
+        kernel.indices.resize((size_t)kernel.taps * destinationSize);
+        kernel.weights.resize((size_t)kernel.taps * destinationSize);
+
+        for (int i = 0; i < destinationSize; i++)
+        {
+            float center = (i + 0.5f) * scale;
+            int first = (int)floorf(center - support);
+            int *indices = &kernel.indices[(size_t)i * kernel.taps];
+            float *weights = &kernel.weights[(size_t)i * kernel.taps];
+            float sum = 0.0f;
+
+            for (int tap = 0; tap < kernel.taps; tap++)
+            {
+                int index = first + tap;
+
+                indices[tap] = std::min(std::max(index, 0), sourceSize - 1);
+                weights[tap] = weight((index + 0.5f - center) / scale);
+                sum += weights[tap];
+            }
+
+            // a footprint no tap lands in takes the texel under its center
+            if (sum == 0.0f)
+            {
+                indices[0] = std::min((int)center, sourceSize - 1);
+                weights[0] = sum = 1.0f;
+            }
+
+            for (int tap = 0; tap < kernel.taps; tap++)
+                weights[tap] /= sum;
+        }
+    }
+
+#if defined(__x86_64__)
+
+    void filterRow(const float *source, int width, float *destination) const
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const int *indices = &columns.indices[(size_t)x * columns.taps];
+            const float *weights = &columns.weights[(size_t)x * columns.taps];
+            __m128 sum = _mm_setzero_ps();
+
+            for (int tap = 0; tap < columns.taps; tap++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), _mm_load_ps(&source[indices[tap] * 4])));
+
+            _mm_store_ps(&destination[x * 4], sum);
+        }
+    }
+
+    void sumRows(const int *indices, const float *weights, int taps, int width, float *destination) const
+    {
+        for (int x = 0; x < width; x++)
+            _mm_store_ps(&destination[x * 4], _mm_setzero_ps());
+
+        for (int tap = 0; tap < taps; tap++)
+        {
+            const float *source = &horizontal[(size_t)indices[tap] * width * 4];
+            __m128 factor = _mm_set1_ps(weights[tap]);
+
+            for (int x = 0; x < width; x++)
+            {
+                __m128 sum = _mm_load_ps(&destination[x * 4]);
+                _mm_store_ps(&destination[x * 4], _mm_add_ps(sum, _mm_mul_ps(factor, _mm_load_ps(&source[x * 4]))));
+            }
+        }
+    }
+
+#else
+
+    void filterRow(const float *source, int width, float *destination) const
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const int *indices = &columns.indices[(size_t)x * columns.taps];
+            const float *weights = &columns.weights[(size_t)x * columns.taps];
+            float sum[4] = {};
+
+            for (int tap = 0; tap < columns.taps; tap++)
+            {
+                for (int channel = 0; channel < 4; channel++)
+                    sum[channel] += weights[tap] * source[indices[tap] * 4 + channel];
+            }
+
+            memcpy(&destination[x * 4], sum, sizeof(sum));
+        }
+    }
+
+    void sumRows(const int *indices, const float *weights, int taps, int width, float *destination) const
+    {
+        memset(destination, 0, (size_t)width * 4 * sizeof(float));
+
+        for (int tap = 0; tap < taps; tap++)
+        {
+            const float *source = &horizontal[(size_t)indices[tap] * width * 4];
+
+            for (int i = 0; i < width * 4; i++)
+                destination[i] += weights[tap] * source[i];
+        }
+    }
+
+#endif
+};
+
+#endif
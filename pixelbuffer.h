@@ -0,0 +1,149 @@
+#ifndef PIXELBUFFER_H
+#define PIXELBUFFER_H
+
+#include "libs/glad.h"
+#include <cstring>
+
+#include "glstate.h"
+
+// pixel buffer objects kept in rotation, enough for a few uploads to be in flight at once
+const unsigned int PIXEL_BUFFER_COUNT = 4;
+
+// uploads larger than this are split into bands of rows spread over several buffers
+const size_t PIXEL_BUFFER_CHUNK_SIZE = 4 * 1024 * 1024;
+
+// streams texture data through a pool of pixel buffer objects
+//
+// each buffer is fenced after the glTexSubImage2D reading it, and only handed out again once
+// the fence has signaled. that makes it safe to map with GL_MAP_UNSYNCHRONIZED_BIT, so writing
+// the next upload never waits for the driver to finish with the previous one.
+class PixelUploadPool
+{
+  public:
+    void create()
+    {
+        glGenBuffers(PIXEL_BUFFER_COUNT, buffers);
+
+        for (unsigned int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+        {
+            fences[i] = 0;
+            capacities[i] = 0;
+        }
+    }
+
+    // copy a width x height RGBA8 region into level of a GL_TEXTURE_2D whose storage already exists
+    void upload(unsigned int texture, int level, int x, int y, int width, int height, const unsigned char *pixels)
+    {
+        stream(GL_TEXTURE_2D, texture, level, x, y, 0, width, height, pixels);
+    }
+
+    // the same into one layer of a GL_TEXTURE_2D_ARRAY
+    void uploadLayer(unsigned int texture, int level, int layer, int x, int y, int width, int height,
+                     const unsigned char *pixels)
+    {
+        stream(GL_TEXTURE_2D_ARRAY, texture, level, x, y, layer, width, height, pixels);
+    }
+
+    void destroy()
+    {
+        for (unsigned int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+        {
+            if (fences[i] != 0)
+                glDeleteSync(fences[i]);
+        }
+
+        gl_state().deleteBuffers(PIXEL_BUFFER_COUNT, buffers);
+    }
+
+  private:
+    unsigned int buffers[PIXEL_BUFFER_COUNT];
+    GLsync fences[PIXEL_BUFFER_COUNT];
+    size_t capacities[PIXEL_BUFFER_COUNT];
+
+    unsigned int next = 0;
+
+    void stream(GLenum target, unsigned int texture, int level, int x, int y, int layer, int width, int height,
+                const unsigned char *pixels)
+    {
+        size_t rowSize = (size_t)width * 4;
+        int bandRows = (int)(PIXEL_BUFFER_CHUNK_SIZE / rowSize);
+
+        if (bandRows < 1)
+            bandRows = 1;
+
+        gl_state().bindTexture(target, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        for (int row = 0; row < height; row += bandRows)
+        {
+            int rows = height - row < bandRows ? height - row : bandRows;
+            size_t size = rowSize * rows;
+
+            unsigned int slot = acquire(size);
+            gl_state().bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[slot]);
+
+            GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            void *staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access);
+
+            if (staging != NULL)
+            {
+                memcpy(staging, pixels + rowSize * row, size);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+                if (target == GL_TEXTURE_2D_ARRAY)
+                {
+                    glTexSubImage3D(target, level, x, y + row, layer, width, rows, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                    (void *)0);
+                }
+                else
+                {
+                    glTexSubImage2D(target, level, x, y + row, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+                }
+            }
+
+            fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        gl_state().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // pick a buffer the gpu is done with, growing its storage if needed
+    unsigned int acquire(size_t size)
+    {
+        unsigned int slot = next;
+
+        // prefer any buffer whose fence already signaled, only wait when all of them are busy
+        for (unsigned int i = 0; i < PIXEL_BUFFER_COUNT; i++)
+        {
+            unsigned int candidate = (next + i) % PIXEL_BUFFER_COUNT;
+
+            if (fences[candidate] == 0 || glClientWaitSync(fences[candidate], 0, 0) != GL_TIMEOUT_EXPIRED)
+            {
+                slot = candidate;
+                break;
+            }
+        }
+
+        if (fences[slot] != 0)
+        {
+            while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+        }
+
+        if (capacities[slot] < size)
+        {
+            gl_state().bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[slot]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+            capacities[slot] = size;
+        }
+
+        next = (slot + 1) % PIXEL_BUFFER_COUNT;
+
+        return slot;
+    }
+};
+
+#endif
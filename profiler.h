@@ -0,0 +1,248 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "libs/glad.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "glstate.h"
+
+// frames a query stays in flight before its result is read, deep enough that reading never stalls
+const unsigned int PROFILER_FRAMES = 4;
+
+// scopes that can be opened in one frame
+const unsigned int PROFILER_MAX_SCOPES = 64;
+
+// accumulated timings of every scope sharing a name
+struct ProfileStats
+{
+    const char *name;
+
+    double cpuTotal, cpuMin, cpuMax;
+    unsigned int cpuCount;
+
+    double gpuTotal, gpuMin, gpuMax;
+    unsigned int gpuCount;
+};
+
+// cpu and gpu timings of named scopes
+//
+// every scope brackets its gl commands with GL_TIMESTAMP queries. the queries of a frame
+// are read back PROFILER_FRAMES frames later, when the slot is reused; results that are
+// still not available then are dropped rather than waited for. reports first wait for the
+// frames still in flight, so short runs have gpu times too.
+class Profiler
+{
+  public:
+    bool enabled = false;
+
+    void create()
+    {
+        enabled = true;
+
+        glGenQueries(PROFILER_FRAMES * PROFILER_MAX_SCOPES * 2, queries);
+
+        for (unsigned int i = 0; i < PROFILER_FRAMES; i++)
+            frames[i].count = 0;
+    }
+
+    void beginFrame()
+    {
+        if (!enabled)
+            return;
+
+        slot = (slot + 1) % PROFILER_FRAMES;
+        collect(slot);
+    }
+
+    // open a scope, returns a handle for end()
+    int begin(const char *name)
+    {
+        if (!enabled || frames[slot].count == PROFILER_MAX_SCOPES)
+            return -1;
+
+        int index = frames[slot].count++;
+        ScopeRecord &record = frames[slot].scopes[index];
+
+        record.stats = findStats(name);
+        record.cpuStart = std::chrono::steady_clock::now();
+
+        glQueryCounter(query(index, 0), GL_TIMESTAMP);
+
+        return index;
+    }
+
+    void end(int index)
+    {
+        if (index < 0)
+            return;
+
+        ScopeRecord &record = frames[slot].scopes[index];
+
+        glQueryCounter(query(index, 1), GL_TIMESTAMP);
+
+        double cpu = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record.cpuStart).count();
+        ProfileStats &stats = scopeStats[record.stats];
+
+        stats.cpuTotal += cpu;
+        stats.cpuMin = stats.cpuCount == 0 || cpu < stats.cpuMin ? cpu : stats.cpuMin;
+        stats.cpuMax = cpu > stats.cpuMax ? cpu : stats.cpuMax;
+        stats.cpuCount++;
+    }
+
+    // print average, min and max cpu and gpu time per scope, then the gl state calls per frame
+    void report(FILE *file)
+    {
+        finish();
+
+        fprintf(file, "%-12s %10s %10s %10s   %10s %10s %10s\n", "scope", "cpu avg", "cpu min", "cpu max", "gpu avg",
+                "gpu min", "gpu max");
+
+        for (const ProfileStats &stats : scopeStats)
+        {
+            fprintf(file, "%-12s %10.4f %10.4f %10.4f   %10.4f %10.4f %10.4f\n", stats.name, cpuAverage(stats),
+                    stats.cpuMin, stats.cpuMax, gpuAverage(stats), stats.gpuMin, stats.gpuMax);
+        }
+
+        fprintf(file, "\n");
+        gl_state().report(file);
+    }
+
+    // scope averages as a json object body, one "name": {...} entry per line
+    void writeJson(FILE *file)
+    {
+        finish();
+
+        for (size_t i = 0; i < scopeStats.size(); i++)
+        {
+            const ProfileStats &stats = scopeStats[i];
+
+            fprintf(file, "    \"%s\": {\"cpu_ms\": %.4f, \"gpu_ms\": %.4f}%s\n", stats.name, cpuAverage(stats),
+                    gpuAverage(stats), i + 1 < scopeStats.size() ? "," : "");
+        }
+    }
+
+    void destroy()
+    {
+        if (enabled)
+            glDeleteQueries(PROFILER_FRAMES * PROFILER_MAX_SCOPES * 2, queries);
+    }
+
+  private:
+    struct ScopeRecord
+    {
+        unsigned int stats;
+        std::chrono::steady_clock::time_point cpuStart;
+    };
+
+    struct FrameRecord
+    {
+        ScopeRecord scopes[PROFILER_MAX_SCOPES];
+        unsigned int count;
+    };
+
+    unsigned int queries[PROFILER_FRAMES * PROFILER_MAX_SCOPES * 2];
+    FrameRecord frames[PROFILER_FRAMES];
+    unsigned int slot = 0;
+
+    std::vector<ProfileStats> scopeStats;
+
+    unsigned int query(int index, int end)
+    {
+        return queries[(slot * PROFILER_MAX_SCOPES + index) * 2 + end];
+    }
+
+    // scopes are few, a linear search keeps the per-frame path free of allocation once they are known
+    unsigned int findStats(const char *name)
+    {
+        for (unsigned int i = 0; i < scopeStats.size(); i++)
+        {
+            if (scopeStats[i].name == name || strcmp(scopeStats[i].name, name) == 0)
+                return i;
+        }
+
+        ProfileStats stats = {};
+        stats.name = name;
+        scopeStats.push_back(stats);
+
+        return scopeStats.size() - 1;
+    }
+
+    // read the queries of every frame still in flight, oldest first, waiting for their results
+    void finish()
+    {
+        if (!enabled)
+            return;
+
+        for (unsigned int i = 1; i <= PROFILER_FRAMES; i++)
+            collect((slot + i) % PROFILER_FRAMES, true);
+    }
+
+    void collect(unsigned int frame, bool wait = false)
+    {
+        FrameRecord &record = frames[frame];
+
+        for (unsigned int i = 0; i < record.count; i++)
+        {
+            unsigned int start = queries[(frame * PROFILER_MAX_SCOPES + i) * 2];
+            unsigned int end = queries[(frame * PROFILER_MAX_SCOPES + i) * 2 + 1];
+
+            int available = 0;
+            glGetQueryObjectiv(end, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (!available && !wait)
+                continue;
+
+            GLuint64 startTime, endTime;
+            glGetQueryObjectui64v(start, GL_QUERY_RESULT, &startTime);
+            glGetQueryObjectui64v(end, GL_QUERY_RESULT, &endTime);
+
+            double gpu = (endTime - startTime) / 1000000.0;
+            ProfileStats &stats = scopeStats[record.scopes[i].stats];
+
+            stats.gpuTotal += gpu;
+            stats.gpuMin = stats.gpuCount == 0 || gpu < stats.gpuMin ? gpu : stats.gpuMin;
+            stats.gpuMax = gpu > stats.gpuMax ? gpu : stats.gpuMax;
+            stats.gpuCount++;
+        }
+
+        record.count = 0;
+    }
+
+    static double cpuAverage(const ProfileStats &stats)
+    {
+        return stats.cpuCount > 0 ? stats.cpuTotal / stats.cpuCount : 0.0;
+    }
+
+    static double gpuAverage(const ProfileStats &stats)
+    {
+        return stats.gpuCount > 0 ? stats.gpuTotal / stats.gpuCount : 0.0;
+    }
+};
+
+// times the enclosing block
+class ProfileScope
+{
+  public:
+    ProfileScope(Profiler &owner, const char *name) : profiler(owner)
+    {
+        index = profiler.begin(name);
+    }
+
+    ~ProfileScope()
+    {
+        profiler.end(index);
+    }
+
+  private:
+    Profiler &profiler;
+    int index;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(profiler, name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(profiler, name)
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// bounded lock-free queue for any number of producers and consumers (Vyukov's MPMC ring)
+//
+// each cell carries a sequence number telling whether it is free for the producer of a
+// given position or holds the value for the consumer of it, so threads only contend on
+// the head and tail counters.
+template <typename T> class ConcurrentQueue
+{
+  public:
+    // capacity is rounded up to a power of two
+    explicit ConcurrentQueue(size_t capacity)
+    {
+        size_t size = 1;
+
+        while (size < capacity)
+            size *= 2;
+
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // returns false when the queue is full
+    bool push(const T &value)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)position;
+
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // returns false when the queue is empty
+    bool pop(T &value)
+    {
+        size_t position = head.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1);
+
+            if (difference == 0)
+            {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+  private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // keep the counters on separate cache lines, producers and consumers write different ones
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> head{0};
+};
+
+#endif
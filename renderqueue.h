@@ -0,0 +1,324 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+
+// width of each sort key field, from the most significant bits down
+//
+// opaque:      pass | layer | program | texture | mesh | depth
+// translucent: pass | layer | depth | program | texture | mesh
+//
+// opaque draws group by state and mesh and go front to back within a mesh, so an instanced draw
+// still covers every instance of a mesh. translucent draws go back to front before anything else.
+const int RENDER_KEY_PASS_BITS = 3;
+const int RENDER_KEY_LAYER_BITS = 1;
+const int RENDER_KEY_PROGRAM_BITS = 12;
+const int RENDER_KEY_TEXTURE_BITS = 12;
+const int RENDER_KEY_MESH_BITS = 20;
+const int RENDER_KEY_DEPTH_BITS = 16;
+
+// bits of the key sorted on per radix pass
+const int RENDER_QUEUE_RADIX_BITS = 8;
+const int RENDER_QUEUE_RADIX_SIZE = 1 << RENDER_QUEUE_RADIX_BITS;
+const int RENDER_QUEUE_RADIX_PASSES = 64 / RENDER_QUEUE_RADIX_BITS;
+
+enum class RenderLayer
+{
+    Opaque,
+    Translucent
+};
+
+// small dense ids for the programs or textures that sort keys refer to
+//
+// gl names can be anywhere in 32 bits, masked into a key field two of them could share bits and
+// interleave in the sort. each name is added once on the gl thread before any submission, the
+// key holds its id and name() turns a key's id back into something to bind.
+class RenderStateIds
+{
+  public:
+    // ids run up to 1 << bits, the width of the key field they go in
+    void create(int bits)
+    {
+        limit = 1u << bits;
+        names.clear();
+        ids.clear();
+    }
+
+    // the id of name, assigning the next one on first use, throws std::runtime_error once the field is full
+    unsigned int add(unsigned int name)
+    {
+        auto found = ids.find(name);
+
+        if (found != ids.end())
+            return found->second;
+
+        if (names.size() == limit)
+            throw std::runtime_error("Failed to add render state: more than " + std::to_string(limit) + " ids");
+
+        names.push_back(name);
+        ids[name] = names.size() - 1;
+
+        return names.size() - 1;
+    }
+
+    unsigned int name(unsigned int id) const
+    {
+        return names[id];
+    }
+
+  private:
+    unsigned int limit = 0;
+    std::vector<unsigned int> names;
+    std::unordered_map<unsigned int, unsigned int> ids;
+};
+
+struct RenderItem
+{
+    uint64_t key;
+    uint32_t instance;
+    const Mesh *mesh;
+};
+
+// per frame list of draw submissions ordered by a 64 bit sort key
+//
+// storage is allocated once for a fixed number of submissions, submitting past it drops the draw
+// and counts it. sorting is a stable lsd radix sort, so equal keys keep their submission order.
+class RenderQueue
+{
+  public:
+    // submissions that didn't fit since the last clear
+    unsigned int dropped = 0;
+
+    void create(size_t capacity)
+    {
+        items.resize(capacity);
+        scratch.resize(capacity);
+        count = 0;
+    }
+
+    void clear()
+    {
+        count = 0;
+        dropped = 0;
+    }
+
+    // program and texture are RenderStateIds ids, not gl names
+    //
+    // depth is the view space distance along the camera's front vector, returns false when the queue is full
+    bool submit(unsigned int pass, RenderLayer layer, unsigned int program, unsigned int texture, const Mesh &mesh,
+                float depth, uint32_t instance)
+    {
+        if (count == items.size())
+        {
+            dropped++;
+            return false;
+        }
+
+        uint64_t state = field(program, RENDER_KEY_PROGRAM_BITS) << (RENDER_KEY_TEXTURE_BITS + RENDER_KEY_MESH_BITS) |
+                         field(texture, RENDER_KEY_TEXTURE_BITS) << RENDER_KEY_MESH_BITS |
+                         field(mesh.id, RENDER_KEY_MESH_BITS);
+
+        uint64_t key = field(pass, RENDER_KEY_PASS_BITS) << (64 - RENDER_KEY_PASS_BITS);
+
+        if (layer == RenderLayer::Opaque)
+        {
+            key |= state << RENDER_KEY_DEPTH_BITS | depthBucket(depth);
+        }
+        else
+        {
+            uint64_t farToNear = ((1 << RENDER_KEY_DEPTH_BITS) - 1) - depthBucket(depth);
+
+            key |= (uint64_t)1 << (64 - RENDER_KEY_PASS_BITS - RENDER_KEY_LAYER_BITS) |
+                   farToNear << STATE_BITS | state;
+        }
+
+        items[count++] = {key, instance, &mesh};
+        return true;
+    }
+
+    void sort()
+    {
+        uint32_t histograms[RENDER_QUEUE_RADIX_PASSES][RENDER_QUEUE_RADIX_SIZE] = {};
+
+        // one read of the keys counts the digits of every pass
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t key = items[i].key;
+
+            for (int pass = 0; pass < RENDER_QUEUE_RADIX_PASSES; pass++)
+                histograms[pass][(key >> (pass * RENDER_QUEUE_RADIX_BITS)) & (RENDER_QUEUE_RADIX_SIZE - 1)]++;
+        }
+
+        RenderItem *source = items.data();
+        RenderItem *destination = scratch.data();
+
+        for (int pass = 0; pass < RENDER_QUEUE_RADIX_PASSES; pass++)
+        {
+            uint32_t *histogram = histograms[pass];
+            int shift = pass * RENDER_QUEUE_RADIX_BITS;
+
+            // unused key bits and fields shared by every item would move nothing
+            if (count == 0 || histogram[(source[0].key >> shift) & (RENDER_QUEUE_RADIX_SIZE - 1)] == count)
+                continue;
+
+            uint32_t offset = 0;
+
+            for (int digit = 0; digit < RENDER_QUEUE_RADIX_SIZE; digit++)
+            {
+                uint32_t total = histogram[digit];
+                histogram[digit] = offset;
+                offset += total;
+            }
+
+            for (size_t i = 0; i < count; i++)
+                destination[histogram[(source[i].key >> shift) & (RENDER_QUEUE_RADIX_SIZE - 1)]++] = source[i];
+
+            std::swap(source, destination);
+        }
+
+        if (source != items.data())
+            memcpy(items.data(), source, count * sizeof(RenderItem));
+    }
+
+    // replace the contents with the union of queues that are sorted already
+    //
+    // ties go to the earlier queue, so the result is what sorting the queues concatenated in order
+    // would give, however the work producing them was split.
+    void merge(const RenderQueue *queues, size_t queueCount)
+    {
+        clear();
+        heads.clear();
+
+        for (size_t i = 0; i < queueCount; i++)
+        {
+            dropped += queues[i].dropped;
+
+            if (queues[i].count > 0)
+                heads.push_back({queues[i].items[0].key, (uint32_t)i, 0});
+        }
+
+        std::make_heap(heads.begin(), heads.end(), laterHead);
+
+        while (!heads.empty())
+        {
+            std::pop_heap(heads.begin(), heads.end(), laterHead);
+            MergeHead &head = heads.back();
+            const RenderQueue &queue = queues[head.queue];
+
+            if (count < items.size())
+                items[count++] = queue.items[head.position];
+            else
+                dropped++;
+
+            if (++head.position < queue.count)
+            {
+                head.key = queue.items[head.position].key;
+                std::push_heap(heads.begin(), heads.end(), laterHead);
+            }
+            else
+            {
+                heads.pop_back();
+            }
+        }
+    }
+
+    const RenderItem *begin() const
+    {
+        return items.data();
+    }
+
+    const RenderItem *end() const
+    {
+        return items.data() + count;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t capacity() const
+    {
+        return items.size();
+    }
+
+    // the key without its depth, equal for draws of the same mesh with the same state
+    static uint64_t batchKey(uint64_t key)
+    {
+        if (translucent(key))
+            return key & ~((((uint64_t)1 << RENDER_KEY_DEPTH_BITS) - 1) << STATE_BITS);
+
+        return key >> RENDER_KEY_DEPTH_BITS;
+    }
+
+    static unsigned int program(uint64_t key)
+    {
+        return (stateBits(key) >> (RENDER_KEY_TEXTURE_BITS + RENDER_KEY_MESH_BITS)) &
+               ((1 << RENDER_KEY_PROGRAM_BITS) - 1);
+    }
+
+    static unsigned int texture(uint64_t key)
+    {
+        return (stateBits(key) >> RENDER_KEY_MESH_BITS) & ((1 << RENDER_KEY_TEXTURE_BITS) - 1);
+    }
+
+  private:
+    static const int STATE_BITS = RENDER_KEY_PROGRAM_BITS + RENDER_KEY_TEXTURE_BITS + RENDER_KEY_MESH_BITS;
+
+    std::vector<RenderItem> items;
+    std::vector<RenderItem> scratch;
+    size_t count = 0;
+
+    // next unmerged item of each queue, as a heap with the smallest key on top
+    struct MergeHead
+    {
+        uint64_t key;
+        uint32_t queue;
+        uint32_t position;
+    };
+
+    std::vector<MergeHead> heads;
+
+    static bool laterHead(const MergeHead &a, const MergeHead &b)
+    {
+        return a.key > b.key || (a.key == b.key && a.queue > b.queue);
+    }
+
+    static uint64_t field(unsigned int value, int bits)
+    {
+        return value & ((1u << bits) - 1);
+    }
+
+    static bool translucent(uint64_t key)
+    {
+        return (key >> (64 - RENDER_KEY_PASS_BITS - RENDER_KEY_LAYER_BITS)) & 1;
+    }
+
+    static uint64_t stateBits(uint64_t key)
+    {
+        return translucent(key) ? key : key >> RENDER_KEY_DEPTH_BITS;
+    }
+
+    // the top bits of a positive float keep its order, finer steps near the camera where they matter
+    static uint64_t depthBucket(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(float));
+
+        return bits >> (32 - RENDER_KEY_DEPTH_BITS);
+    }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include "libs/glad.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "arena.h"
+#include "glstate.h"
+#include "util.h"
+
+// number of frames the cpu may run ahead of the gpu before waiting
+const unsigned int RING_BUFFER_FRAMES = 3;
+
+// a region of the ring buffer valid for the current frame
+struct RingAllocation
+{
+    void *data;
+    size_t offset;
+    size_t size;
+};
+
+// streaming buffer for per-frame data, written with plain memcpy
+//
+// with GL_ARB_buffer_storage the buffer is persistently mapped and split into
+// RING_BUFFER_FRAMES regions, each guarded by a fence so a region is only reused
+// once the gpu is done reading it. on plain 3.3 writes go to a cpu staging copy
+// which is uploaded by orphaning the buffer and calling glBufferSubData.
+class RingBuffer
+{
+  public:
+    unsigned int id;
+
+    // most bytes one frame used, against frameSize()
+    size_t highWater = 0;
+
+    void create(size_t size)
+    {
+        frameSize = align(size, 256);
+        bool supported = GLAD_GL_VERSION_4_4 || has_extension("GL_ARB_buffer_storage");
+
+        // glad only loads entry points for the core version it found
+        persistent = supported && glBufferStorage != NULL;
+
+        glGenBuffers(1, &id);
+        gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, id);
+
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+            glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * RING_BUFFER_FRAMES, NULL, flags);
+            memory = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * RING_BUFFER_FRAMES, flags);
+
+            if (memory == NULL)
+                throw std::runtime_error("Failed to map ring buffer");
+        }
+        else
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+            memory = (unsigned char *)aligned_alloc(256, frameSize);
+        }
+
+        for (unsigned int i = 0; i < RING_BUFFER_FRAMES; i++)
+            fences[i] = 0;
+    }
+
+    // start writing the next region, waiting only if the gpu still reads it
+    void beginFrame()
+    {
+        head = persistent ? frame * frameSize : 0;
+        end = head + frameSize;
+
+        if (fences[frame] != 0)
+        {
+            while (glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+
+            glDeleteSync(fences[frame]);
+            fences[frame] = 0;
+        }
+
+#ifdef ARENA_DEBUG
+        // the gpu is done with the region, anything still reading it sees the poison
+        memset(memory + head, ARENA_POISON_RELEASED, frameSize);
+#endif
+    }
+
+    RingAllocation allocate(size_t size, size_t alignment)
+    {
+        size_t offset = align(head, alignment);
+
+        if (offset + size > end)
+            throw std::runtime_error("Ring buffer frame budget exceeded");
+
+        head = offset + size;
+
+        size_t used = head - (end - frameSize);
+        highWater = used > highWater ? used : highWater;
+
+        return {memory + offset, offset, size};
+    }
+
+    // make this frame's writes visible to the gl, must happen before the draws using them
+    void flush()
+    {
+        if (persistent)
+            return;
+
+        gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, head, memory);
+    }
+
+    // fence the region once every draw reading it has been submitted
+    void endFrame()
+    {
+        if (persistent)
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        frame = (frame + 1) % RING_BUFFER_FRAMES;
+    }
+
+    size_t frameCapacity() const
+    {
+        return frameSize;
+    }
+
+    void destroy()
+    {
+        for (unsigned int i = 0; i < RING_BUFFER_FRAMES; i++)
+        {
+            if (fences[i] != 0)
+                glDeleteSync(fences[i]);
+        }
+
+        if (persistent)
+        {
+            gl_state().bindBuffer(GL_COPY_WRITE_BUFFER, id);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        else
+        {
+            free(memory);
+        }
+
+        gl_state().deleteBuffers(1, &id);
+    }
+
+  private:
+    unsigned char *memory;
+    bool persistent;
+
+    size_t frameSize;
+    size_t head;
+    size_t end;
+
+    unsigned int frame = 0;
+    GLsync fences[RING_BUFFER_FRAMES];
+
+    static size_t align(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+};
+
+#endif
@@ -2,14 +2,36 @@
 #define SHADER_H
 
 #include "libs/glad.h"
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "framedata.h"
+#include "glstate.h"
 #include "util.h"
 
+// linked program binaries are kept here, keyed by sources, defines and driver
+const char *const SHADER_CACHE_DIRECTORY = "./cache/shaders";
+
+// header of a cached program binary file, followed by the binary itself
+struct ProgramBinaryHeader
+{
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+const uint32_t PROGRAM_BINARY_MAGIC = 0x42505347; // "GSPB"
+
 class Shader
 {
   public:
@@ -17,8 +39,9 @@ class Shader
 
 	Shader(){}
 
-    // constructor generates the shader on the fly
-    Shader(const char *vertexPath, const char *fragmentPath)
+    // constructor generates the shader on the fly, or loads it from the program binary cache
+    // defines are inserted right after the #version line of both stages
+    Shader(const char *vertexPath, const char *fragmentPath, const std::string &defines = "")
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -29,11 +52,123 @@ class Shader
             vertexCode = read_file(vertexPath);
             fragmentCode = read_file(fragmentPath);
         }
-        catch (std::ifstream::failure &e)
+        catch (std::runtime_error &e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
 
+        vertexCode = insertDefines(vertexCode, defines);
+        fragmentCode = insertDefines(fragmentCode, defines);
+
+        uint64_t key = cacheKey(vertexCode, fragmentCode, defines);
+        bool cacheable = binaryCacheSupported();
+
+        if (!cacheable || !loadBinary(key))
+        {
+            compile(vertexCode, fragmentCode, cacheable);
+
+            if (cacheable)
+                saveBinary(key);
+        }
+
+        cacheUniforms();
+        bindUniformBlocks();
+    }
+
+    // activate the shader
+    void use()
+    {
+        gl_state().useProgram(id);
+    }
+
+    // look up a cached uniform location once, the result is used with the handle based setters below
+    int getUniform(const std::string &name) const
+    {
+        auto found = uniforms.find(name);
+
+        if (found == uniforms.end())
+            return -1;
+
+        return found->second;
+    }
+
+    // handle based uniform functions, no string lookup on the per-frame path
+    void setBool(int location, bool value) const
+    {
+        glUniform1i(location, (int)value);
+    }
+
+    void setInt(int location, int value) const
+    {
+        glUniform1i(location, value);
+    }
+
+    void setUint(int location, unsigned int value) const
+    {
+        glUniform1ui(location, value);
+    }
+
+    void setFloat(int location, float value) const
+    {
+        glUniform1f(location, value);
+    }
+
+    void setVec3(int location, float x, float y, float z) const
+    {
+        glUniform3f(location, x, y, z);
+    }
+
+    void setVec4(int location, float x, float y, float z, float w) const
+    {
+        glUniform4f(location, x, y, z, w);
+    }
+
+    void setMat4(int location, const glm::mat4 &value) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    // utility uniform functions
+    void setBool(const std::string &name, bool value) const
+    {
+        setBool(getUniform(name), value);
+    }
+
+    void setInt(const std::string &name, int value) const
+    {
+        setInt(getUniform(name), value);
+    }
+
+    void setUint(const std::string &name, unsigned int value) const
+    {
+        setUint(getUniform(name), value);
+    }
+
+    void setFloat(const std::string &name, float value) const
+    {
+        setFloat(getUniform(name), value);
+    }
+
+	void setVec3(const std::string &name, float x, float y, float z) const
+	{
+		setVec3(getUniform(name), x, y, z);
+	}
+
+    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    {
+        setVec4(getUniform(name), x, y, z, w);
+    }
+
+    void setMat4(const std::string &name, const glm::mat4 &value) const
+    {
+        setMat4(getUniform(name), value);
+    }
+
+  private:
+    std::unordered_map<std::string, int> uniforms;
+
+    void compile(const std::string &vertexCode, const std::string &fragmentCode, bool retrievable)
+    {
         const char *vShaderCode = vertexCode.c_str();
         const char *fShaderCode = fragmentCode.c_str();
 
@@ -54,6 +189,10 @@ class Shader
 
         // shader Program
         id = glCreateProgram();
+
+        if (retrievable)
+            glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
         glAttachShader(id, vertex);
         glAttachShader(id, fragment);
         glLinkProgram(id);
@@ -64,44 +203,155 @@ class Shader
         glDeleteShader(fragment);
     }
 
-    // activate the shader
-    void use()
+    static std::string insertDefines(const std::string &code, const std::string &defines)
     {
-        glUseProgram(id);
+        if (defines.empty())
+            return code;
+
+        size_t lineEnd = code.find('\n');
+
+        if (code.compare(0, 8, "#version") != 0 || lineEnd == std::string::npos)
+            return defines + "\n" + code;
+
+        return code.substr(0, lineEnd + 1) + defines + "\n" + code.substr(lineEnd + 1);
     }
 
-    // utility uniform functions
-    void setBool(const std::string &name, bool value) const
+    // binaries are only valid for the exact driver that produced them
+    static uint64_t cacheKey(const std::string &vertexCode, const std::string &fragmentCode,
+                             const std::string &defines)
     {
-        glUniform1i(glGetUniformLocation(id, name.c_str()), (int)value);
+        uint64_t key = hash_string(vertexCode);
+        key = hash_string(fragmentCode, key);
+        key = hash_string(defines, key);
+
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+            key = hash_string((const char *)glGetString(name), key);
+
+        return key;
     }
 
-    void setInt(const std::string &name, int value) const
+    static bool binaryCacheSupported()
     {
-        glUniform1i(glGetUniformLocation(id, name.c_str()), value);
+        if (!GLAD_GL_VERSION_4_1 && !has_extension("GL_ARB_get_program_binary"))
+            return false;
+
+        // glad only loads entry points for the core version it found
+        if (glProgramParameteri == NULL || glGetProgramBinary == NULL || glProgramBinary == NULL)
+            return false;
+
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+        return formats > 0;
     }
 
-    void setFloat(const std::string &name, float value) const
+    static std::string binaryPath(uint64_t key)
     {
-        glUniform1f(glGetUniformLocation(id, name.c_str()), value);
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+
+        return SHADER_CACHE_DIRECTORY + std::string(name);
     }
 
-	void setVec3(const std::string &name, float x, float y, float z) const
-	{
-		glUniform3f(glGetUniformLocation(id, name.c_str()), x, y ,z);
-	}
+    // returns false when there is no usable binary, e.g. after a driver update
+    bool loadBinary(uint64_t key)
+    {
+        FILE *file = fopen(binaryPath(key).c_str(), "rb");
 
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
+        if (file == NULL)
+            return false;
+
+        ProgramBinaryHeader header;
+        std::vector<char> binary;
+
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == PROGRAM_BINARY_MAGIC &&
+                     header.key == key;
+
+        if (valid)
+        {
+            binary.resize(header.length);
+            valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+
+        fclose(file);
+
+        if (!valid)
+            return false;
+
+        id = glCreateProgram();
+        glProgramBinary(id, header.format, binary.data(), header.length);
+
+        int success = 0;
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+
+        if (!success)
+        {
+            gl_state().deleteProgram(id);
+            return false;
+        }
+
+        return true;
+    }
+
+    void saveBinary(uint64_t key)
+    {
+        int length = 0;
+        glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+        if (length <= 0 || !make_directories(SHADER_CACHE_DIRECTORY))
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(id, length, NULL, &format, binary.data());
+
+        ProgramBinaryHeader header = {PROGRAM_BINARY_MAGIC, format, key, (uint32_t)length, 0};
+
+        write_cache_file(binaryPath(key),
+                         {{0, &header, sizeof(header)}, {sizeof(header), binary.data(), binary.size()}});
+    }
+
+    // resolve every active uniform location once after linking
+    void cacheUniforms()
     {
-        glUniform4f(glGetUniformLocation(id, name.c_str()), x, y, z, w);
+        int count = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+
+        int maxLength = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::string name(maxLength, '\0');
+
+        for (int i = 0; i < count; i++)
+        {
+            int length, size;
+            unsigned int type;
+            glGetActiveUniform(id, i, maxLength, &length, &size, &type, &name[0]);
+
+            std::string uniformName = name.substr(0, length);
+            int location = glGetUniformLocation(id, uniformName.c_str());
+
+            // uniforms inside blocks have no location
+            if (location < 0)
+                continue;
+
+            // arrays are reported as "name[0]", make them reachable by their plain name too
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+                uniforms[uniformName.substr(0, uniformName.size() - 3)] = location;
+
+            uniforms[uniformName] = location;
+        }
     }
 
-    void setMat4(const std::string &name, glm::mat4 value) const
+    // attach the shared uniform blocks this program declares to their fixed binding points
+    void bindUniformBlocks()
     {
-        glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        unsigned int frameData = glGetUniformBlockIndex(id, "FrameData");
+
+        if (frameData != GL_INVALID_INDEX)
+            glUniformBlockBinding(id, frameData, FRAME_DATA_BINDING);
     }
 
-  private:
     // utility function for checking shader compilation/linking errors.
     void checkCompileErrors(unsigned int shader, std::string type)
     {
@@ -3,9 +3,19 @@ out vec4 FragColor;
 
 in vec4 vertexColor;
 in vec2 TexCoord;
+flat in float TexLayer;
 
-uniform vec4 ourColor; // we set this variable in the OpenGL code.
-uniform sampler2D ourTexture;
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 transform;
+    vec4 ourColor;
+    vec4 random;
+};
+
+uniform sampler2DArray ourTexture;
 
 void main()
 {
@@ -15,5 +25,5 @@ void main()
 		vertexColor.z + ourColor.z,
 		1.0
 	);
-	FragColor = texture(ourTexture, TexCoord) + finalColor;
+	FragColor = texture(ourTexture, vec3(TexCoord, TexLayer)) + finalColor;
 }
@@ -1,20 +1,40 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in mat4 aModel;
+layout (location = 7) in uint aImage;
 
 out vec4 vertexColor;
 out vec2 TexCoord;
+flat out float TexLayer;
 
-uniform vec3 random;
-uniform mat4 transform;
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 transform;
+    vec4 ourColor;
+    vec4 random;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform uint image;
+uniform bool instanced;
+
+// two texels per atlas image, its uv rectangle and then its layer
+uniform samplerBuffer atlasRegions;
 
 void main()
 {
-    gl_Position = projection * view * model * transform * vec4(aPos + random / 10, 1.0);
+    mat4 modelMatrix = instanced ? aModel : model;
+
+    gl_Position = viewProjection * modelMatrix * transform * vec4(aPos + random.xyz / 10, 1.0);
 	vertexColor = vec4(0.0, 0.0, 1.0, 1.0);
-	TexCoord = aTexCoord;
+
+    int region = int(instanced ? aImage : image) * 2;
+    vec4 rect = texelFetch(atlasRegions, region);
+
+	TexCoord = rect.xy + aTexCoord * rect.zw;
+    TexLayer = texelFetch(atlasRegions, region + 1).x;
 }
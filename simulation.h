@@ -0,0 +1,164 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include <mutex>
+
+#include "camera.h"
+
+// length of one simulation step in seconds, however long frames take to draw
+const double SIMULATION_STEP = 1.0 / 120.0;
+
+// degrees of rotation per pixel of mouse movement
+const float MOUSE_SENSITIVITY = 0.1f;
+
+// input gathered for one step
+struct SimulationInput
+{
+    // movement along the camera's right, up and front axes, each -1, 0 or 1
+    glm::vec3 move = glm::vec3(0.0f);
+
+    // mouse movement since the last step in degrees
+    float yawOffset = 0.0f;
+    float pitchOffset = 0.0f;
+};
+
+// everything a frame reads from the simulation
+struct SimulationState
+{
+    double time = 0.0;
+
+    glm::vec3 position;
+    glm::vec3 front;
+    float yaw = -90.0f;
+    float pitch = 0.0f;
+};
+
+// advances the camera in fixed steps, so movement doesn't depend on the frame rate
+class Simulation
+{
+  public:
+    SimulationState state;
+
+    void create(const glm::vec3 &position, const glm::vec3 &front, float cameraSpeed)
+    {
+        state.position = position;
+        state.front = front;
+        speed = cameraSpeed;
+        steps = 0;
+    }
+
+    // time of the next step
+    double nextTime() const
+    {
+        return (steps + 1) * SIMULATION_STEP;
+    }
+
+    void step(const SimulationInput &input)
+    {
+        if (input.yawOffset != 0.0f || input.pitchOffset != 0.0f)
+        {
+            state.yaw += input.yawOffset;
+            state.pitch = glm::clamp(state.pitch + input.pitchOffset, -89.0f, 89.0f);
+            state.front = frontFromAngles(state.yaw, state.pitch);
+        }
+
+        glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 right = glm::normalize(glm::cross(state.front, up));
+        float distance = speed * (float)SIMULATION_STEP;
+
+        state.position += distance * (input.move.x * right + input.move.y * up + input.move.z * state.front);
+
+        advance();
+    }
+
+    // step to a pose given from outside, such as a scripted camera path sampled at nextTime()
+    void step(const glm::vec3 &position, float yaw, float pitch)
+    {
+        place(position, yaw, pitch);
+        advance();
+    }
+
+    // move the camera without taking a step
+    void place(const glm::vec3 &position, float yaw, float pitch)
+    {
+        state.position = position;
+        state.yaw = yaw;
+        state.pitch = pitch;
+        state.front = frontFromAngles(yaw, pitch);
+    }
+
+  private:
+    float speed = DEFAULT_SPEED;
+    unsigned long long steps = 0;
+
+    void advance()
+    {
+        steps++;
+        state.time = steps * SIMULATION_STEP;
+    }
+
+    // same direction Camera::setRotation points at
+    static glm::vec3 frontFromAngles(float yaw, float pitch)
+    {
+        glm::vec3 direction;
+        direction.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+        direction.y = sin(glm::radians(pitch));
+        direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+
+        return glm::normalize(direction);
+    }
+};
+
+// the two latest simulation states, published by the simulation and blended by the renderer
+//
+// frames are drawn at a time between the two, so motion stays smooth when steps and frames
+// don't line up. the lock is only held to copy the states.
+class SnapshotBuffer
+{
+  public:
+    void reset(const SimulationState &state)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        previous = current = state;
+    }
+
+    void publish(const SimulationState &state)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        previous = current;
+        current = state;
+    }
+
+    // the state at time, clamped to the range the two snapshots cover
+    SimulationState sample(double time)
+    {
+        SimulationState a, b;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            a = previous;
+            b = current;
+        }
+
+        double span = b.time - a.time;
+        float alpha = span > 0.0 ? (float)glm::clamp((time - a.time) / span, 0.0, 1.0) : 1.0f;
+
+        SimulationState state = b;
+        state.time = time;
+        state.position = glm::mix(a.position, b.position, alpha);
+
+        if (a.front != b.front)
+            state.front = glm::normalize(glm::mix(a.front, b.front, alpha));
+
+        return state;
+    }
+
+  private:
+    std::mutex mutex;
+    SimulationState previous;
+    SimulationState current;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "libs/glad.h"
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libs/stb_image.h"
+
+#include "atlas.h"
+#include "pixelbuffer.h"
+#include "queue.h"
+#include "threadpool.h"
+#include "glstate.h"
+#include "util.h"
+
+// packed atlases waiting for the gl thread
+const size_t ATLAS_QUEUE_CAPACITY = 16;
+
+// uploads done per update() call so a burst of finished atlases can't stall one frame
+const unsigned int TEXTURE_UPLOADS_PER_FRAME = 4;
+
+// one atlas on its way from the source files to the gl thread, shared by the jobs building it
+struct AtlasBuild
+{
+    TextureAtlas *atlas;
+    std::vector<std::string> paths;
+    AtlasLimits limits;
+    bool compress;
+    uint64_t key;
+
+    // one entry per path, stb_image memory or NULL for images that failed and show white
+    std::vector<unsigned char *> decoded;
+    std::vector<AtlasImage> images;
+    std::atomic<unsigned int> remaining{0};
+
+    PackedAtlas packed;
+    bool valid = false;
+};
+
+// loads texture atlases without blocking the render loop
+//
+// loadAtlas() hands back an atlas immediately, every image showing a white placeholder. workers
+// decode the files with stb_image, pack them into one array texture, build the mip chain with the
+// chosen filter and pass the result through a lock-free queue. update() on the gl thread streams it
+// through the pixel buffer pool.
+//
+// the packed result goes to the atlas cache with its mip chain, so later launches map it instead of
+// decoding, packing and filtering again. with compression on, the levels are block compressed to
+// BC1, or BC3 for images with alpha, and the gpu gets them as is.
+class TextureLoader
+{
+  public:
+    TextureLoader() : built(ATLAS_QUEUE_CAPACITY)
+    {
+    }
+
+    // compress asks for block compressed atlases, ignored when the driver can't sample them, and
+    // filter is what the mipmaps are built with
+    void create(bool compress = false, MipFilter filter = MipFilter::Kaiser)
+    {
+        unsigned int threads = std::thread::hardware_concurrency();
+        pool.create(threads > 1 ? threads - 1 : 1);
+        uploads.create();
+
+        compressAtlases = compress && has_extension("GL_EXT_texture_compression_s3tc");
+        mipFilter = filter;
+    }
+
+    // an atlas of every image in paths, indexed in the same order
+    TextureAtlas *loadAtlas(const std::vector<std::string> &paths)
+    {
+        atlases.emplace_back();
+        atlases.back().create(paths.size());
+
+        AtlasBuild *build = new AtlasBuild();
+        build->atlas = &atlases.back();
+        build->paths = paths;
+        build->compress = compressAtlases;
+
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &build->limits.maxSize);
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &build->limits.maxLayers);
+
+        pending++;
+        pool.submit([this, build] { lookupAtlas(build); });
+
+        return build->atlas;
+    }
+
+    // upload atlases that finished, call once per frame on the gl thread
+    void update()
+    {
+        AtlasBuild *build;
+
+        for (unsigned int i = 0; i < TEXTURE_UPLOADS_PER_FRAME && built.pop(build); i++)
+            uploadAtlas(build);
+    }
+
+    // block until every requested atlas is uploaded, for runs that need final images from frame one
+    void finish()
+    {
+        AtlasBuild *build;
+
+        while (pending > 0)
+        {
+            if (built.pop(build))
+                uploadAtlas(build);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    void destroy()
+    {
+        pool.destroy();
+        uploads.destroy();
+
+        AtlasBuild *build;
+
+        while (built.pop(build))
+            delete build;
+
+        for (TextureAtlas &atlas : atlases)
+            atlas.destroy();
+
+        atlases.clear();
+    }
+
+  private:
+    ThreadPool pool;
+    PixelUploadPool uploads;
+    ConcurrentQueue<AtlasBuild *> built;
+    std::atomic<unsigned int> pending{0};
+
+    // deque so handed out pointers stay valid as more atlases load
+    std::deque<TextureAtlas> atlases;
+    bool compressAtlases = false;
+    MipFilter mipFilter = MipFilter::Kaiser;
+
+    // image data is sRGB, rows are filtered on the pool
+    MipBuilder mipBuilder()
+    {
+        MipBuilder builder;
+        builder.filter = mipFilter;
+        builder.pool = &pool;
+
+        return builder;
+    }
+
+    // worker side, a cached atlas is used as is, otherwise every image is decoded on its own job
+    void lookupAtlas(AtlasBuild *build)
+    {
+        build->key = atlas_cache_key(build->paths, build->limits, build->compress, mipBuilder());
+
+        if (load_atlas_cache(build->key, build->packed) && build->packed.regions.size() == build->paths.size())
+        {
+            build->valid = true;
+            push(build);
+
+            return;
+        }
+
+        if (build->paths.empty())
+        {
+            push(build);
+            return;
+        }
+
+        build->packed = PackedAtlas();
+        build->decoded.assign(build->paths.size(), NULL);
+        build->images.resize(build->paths.size());
+        build->remaining = build->paths.size();
+
+        for (size_t i = 0; i < build->paths.size(); i++)
+            pool.submit([this, build, i] { decodeAtlasImage(build, i); });
+    }
+
+    void decodeAtlasImage(AtlasBuild *build, size_t index)
+    {
+        static const unsigned char white[4] = {255, 255, 255, 255};
+
+        const std::string &path = build->paths[index];
+        AtlasImage image = {white, 1, 1};
+        int width, height, channels;
+
+        try
+        {
+            MappedFile file(path);
+
+            stbi_set_flip_vertically_on_load_thread(true);
+            unsigned char *pixels = stbi_load_from_memory((const stbi_uc *)file.data(), (int)file.size(), &width,
+                                                          &height, &channels, 4);
+
+            // a packed image needs its padding to fit in a page too
+            int largest = build->limits.maxSize - 2 * ATLAS_PADDING;
+
+            if (pixels == NULL)
+            {
+                std::cout << "Failed to decode texture " << path << ": " << stbi_failure_reason() << std::endl;
+            }
+            else if (width > largest || height > largest)
+            {
+                std::cout << "Failed to pack texture " << path << ": larger than " << largest << std::endl;
+                stbi_image_free(pixels);
+            }
+            else
+            {
+                build->decoded[index] = pixels;
+                image = {pixels, width, height};
+            }
+        }
+        catch (std::runtime_error &e)
+        {
+            std::cout << "Failed to load texture: " << e.what() << std::endl;
+        }
+
+        build->images[index] = image;
+
+        // the last image in packs the atlas
+        if (build->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            packAtlas(build);
+    }
+
+    void packAtlas(AtlasBuild *build)
+    {
+        try
+        {
+            PackedAtlas &packed = build->packed;
+            pack_atlas(build->images, build->limits, packed);
+
+            // judged on the images, the unused parts of packed pages are transparent
+            TextureFormat format = build->compress ? TextureFormat::BC1 : TextureFormat::RGBA8;
+
+            for (const AtlasImage &image : build->images)
+            {
+                if (build->compress &&
+                    choose_block_format(image.pixels, (size_t)image.width * image.height) == TextureFormat::BC3)
+                    format = TextureFormat::BC3;
+            }
+
+            encode_atlas(packed, format, mipBuilder());
+
+            save_atlas_cache(build->key, packed);
+
+            build->valid = true;
+        }
+        catch (std::runtime_error &e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+
+        push(build);
+    }
+
+    void push(AtlasBuild *build)
+    {
+        // the pixels are in packed now, or in its mapped cache file
+        for (unsigned char *pixels : build->decoded)
+            stbi_image_free(pixels);
+
+        build->decoded.clear();
+        build->images.clear();
+
+        while (!built.push(build))
+            std::this_thread::yield();
+    }
+
+    void uploadAtlas(AtlasBuild *build)
+    {
+        pending--;
+
+        if (build->valid)
+            build->atlas->upload(build->packed, uploads);
+
+        delete build;
+    }
+};
+
+#endif
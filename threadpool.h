@@ -0,0 +1,145 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads running queued jobs in submission order
+class ThreadPool
+{
+  public:
+    void create(unsigned int threadCount)
+    {
+        if (threadCount == 0)
+            threadCount = 1;
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { work(); });
+    }
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+
+        wake.notify_one();
+    }
+
+    // split [0, count) into ranges of at most grain items and run function(begin, end) on each
+    //
+    // the calling thread takes the first range and runs queued jobs until the rest are done, so
+    // a job of this pool can call it without waiting on workers that are all busy waiting too.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &function)
+    {
+        grain = grain > 0 ? grain : 1;
+
+        if (count <= grain)
+        {
+            function(0, count);
+            return;
+        }
+
+        std::atomic<size_t> remaining{(count + grain - 1) / grain - 1};
+
+        for (size_t begin = grain; begin < count; begin += grain)
+        {
+            size_t end = begin + grain < count ? begin + grain : count;
+
+            submit([&function, &remaining, begin, end] {
+                function(begin, end);
+                remaining.fetch_sub(1, std::memory_order_release);
+            });
+        }
+
+        function(0, grain);
+
+        while (remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (!runQueued())
+                std::this_thread::yield();
+        }
+    }
+
+    // finish queued jobs and join the workers
+    void destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+
+        for (std::thread &worker : workers)
+            worker.join();
+
+        workers.clear();
+    }
+
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+                if (jobs.empty())
+                    return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            job();
+        }
+    }
+
+    // run the oldest queued job on the calling thread, returns false when there was none
+    bool runQueued()
+    {
+        std::function<void()> job;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (jobs.empty())
+                return false;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+        return true;
+    }
+};
+
+// ThreadPool::parallelFor on pool, or the whole range on the calling thread when there is none
+inline void parallel_for(ThreadPool *pool, size_t count, size_t grain,
+                         const std::function<void(size_t, size_t)> &function)
+{
+    if (pool != NULL)
+        pool->parallelFor(count, grain, function);
+    else if (count > 0)
+        function(0, count);
+}
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "util.h"
+
+// SIMD kernels consume this many transforms per step, the store keeps its arrays padded to it
+const size_t TRANSFORM_BATCH = 8;
+
+// transforms checked by verify_model_matrices, not a multiple of TRANSFORM_BATCH so the scalar tail runs too
+const size_t TRANSFORM_VERIFY_COUNT = 1003;
+
+// difference allowed per matrix element, relative to the element once it's larger than one
+const float TRANSFORM_VERIFY_TOLERANCE = 1e-5f;
+
+typedef std::vector<float, AlignedAllocator<float, 32>> TransformArray;
+
+// model matrices for a batch of objects, aligned for vector stores and ready for upload
+typedef std::vector<glm::mat4, AlignedAllocator<glm::mat4, 32>> MatrixArray;
+
+// structure-of-arrays storage of object transforms: translation, unit quaternion rotation and scale
+class TransformStore
+{
+  public:
+    TransformArray positionX, positionY, positionZ;
+    TransformArray rotationX, rotationY, rotationZ, rotationW;
+    TransformArray scaleX, scaleY, scaleZ;
+
+    // append a transform rotated by angle (radians) around axis, returns its index
+    size_t add(glm::vec3 position, float angle, glm::vec3 axis, glm::vec3 scale = glm::vec3(1.0f))
+    {
+        size_t index = count++;
+        size_t padded = (count + TRANSFORM_BATCH - 1) / TRANSFORM_BATCH * TRANSFORM_BATCH;
+
+        if (padded > positionX.size())
+        {
+            for (TransformArray *array : arrays())
+                array->resize(padded, 0.0f);
+        }
+
+        glm::vec3 unitAxis = glm::normalize(axis);
+        float halfSin = sinf(angle * 0.5f);
+
+        positionX[index] = position.x;
+        positionY[index] = position.y;
+        positionZ[index] = position.z;
+
+        rotationX[index] = unitAxis.x * halfSin;
+        rotationY[index] = unitAxis.y * halfSin;
+        rotationZ[index] = unitAxis.z * halfSin;
+        rotationW[index] = cosf(angle * 0.5f);
+
+        scaleX[index] = scale.x;
+        scaleY[index] = scale.y;
+        scaleZ[index] = scale.z;
+
+        return index;
+    }
+
+    void clear()
+    {
+        count = 0;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+  private:
+    size_t count = 0;
+
+    std::vector<TransformArray *> arrays()
+    {
+        return {&positionX, &positionY, &positionZ, &rotationX, &rotationY,
+                &rotationZ, &rotationW, &scaleX,    &scaleY,    &scaleZ};
+    }
+};
+
+// reference implementation, translate * rotate * scale for transforms [begin, end)
+inline void buildModelMatricesScalar(const TransformStore &store, glm::mat4 *out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        float x = store.rotationX[i], y = store.rotationY[i], z = store.rotationZ[i], w = store.rotationW[i];
+        float sx = store.scaleX[i], sy = store.scaleY[i], sz = store.scaleZ[i];
+
+        glm::mat4 &m = out[i];
+
+        m[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * sx;
+        m[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * sy;
+        m[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * sz;
+        m[3] = glm::vec4(store.positionX[i], store.positionY[i], store.positionZ[i], 1.0f);
+    }
+}
+
+inline void buildModelMatricesScalar(const TransformStore &store, glm::mat4 *out)
+{
+    buildModelMatricesScalar(store, out, 0, store.size());
+}
+
+#if defined(__x86_64__)
+
+// four objects per step, lanes hold objects and are transposed into column-major matrices on store
+inline size_t buildModelMatricesSSE(const TransformStore &store, glm::mat4 *out)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    size_t end = store.size() / 4 * 4;
+    float *dst = (float *)out;
+
+    for (size_t i = 0; i < end; i += 4)
+    {
+        __m128 x = _mm_load_ps(&store.rotationX[i]);
+        __m128 y = _mm_load_ps(&store.rotationY[i]);
+        __m128 z = _mm_load_ps(&store.rotationZ[i]);
+        __m128 w = _mm_load_ps(&store.rotationW[i]);
+
+        __m128 sx = _mm_load_ps(&store.scaleX[i]);
+        __m128 sy = _mm_load_ps(&store.scaleY[i]);
+        __m128 sz = _mm_load_ps(&store.scaleZ[i]);
+
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        __m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        __m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        __m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+
+        __m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        __m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        __m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+
+        __m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        __m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        __m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+
+        __m128 c3x = _mm_load_ps(&store.positionX[i]);
+        __m128 c3y = _mm_load_ps(&store.positionY[i]);
+        __m128 c3z = _mm_load_ps(&store.positionZ[i]);
+        __m128 c3w = one;
+
+        __m128 c0w = zero, c1w = zero, c2w = zero;
+
+        _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+        _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+        _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+        _MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+
+        float *m = dst + i * 16;
+
+        _mm_store_ps(m + 0, c0x), _mm_store_ps(m + 4, c1x), _mm_store_ps(m + 8, c2x), _mm_store_ps(m + 12, c3x);
+        _mm_store_ps(m + 16, c0y), _mm_store_ps(m + 20, c1y), _mm_store_ps(m + 24, c2y), _mm_store_ps(m + 28, c3y);
+        _mm_store_ps(m + 32, c0z), _mm_store_ps(m + 36, c1z), _mm_store_ps(m + 40, c2z), _mm_store_ps(m + 44, c3z);
+        _mm_store_ps(m + 48, c0w), _mm_store_ps(m + 52, c1w), _mm_store_ps(m + 56, c2w), _mm_store_ps(m + 60, c3w);
+    }
+
+    return end;
+}
+
+// transpose four 8-lane vectors, the low half of each result is object n and the high half object n + 4
+__attribute__((target("avx2,fma"))) inline void storeColumnAVX2(float *m, size_t column, __m256 a, __m256 b, __m256 c,
+                                                                 __m256 d)
+{
+    __m256 t0 = _mm256_unpacklo_ps(a, b);
+    __m256 t1 = _mm256_unpackhi_ps(a, b);
+    __m256 t2 = _mm256_unpacklo_ps(c, d);
+    __m256 t3 = _mm256_unpackhi_ps(c, d);
+
+    __m256 r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+    float *low = m + column * 4;
+    float *high = low + 4 * 16;
+
+    _mm_store_ps(low + 0 * 16, _mm256_castps256_ps128(r0));
+    _mm_store_ps(low + 1 * 16, _mm256_castps256_ps128(r1));
+    _mm_store_ps(low + 2 * 16, _mm256_castps256_ps128(r2));
+    _mm_store_ps(low + 3 * 16, _mm256_castps256_ps128(r3));
+
+    _mm_store_ps(high + 0 * 16, _mm256_extractf128_ps(r0, 1));
+    _mm_store_ps(high + 1 * 16, _mm256_extractf128_ps(r1, 1));
+    _mm_store_ps(high + 2 * 16, _mm256_extractf128_ps(r2, 1));
+    _mm_store_ps(high + 3 * 16, _mm256_extractf128_ps(r3, 1));
+}
+
+// eight objects per step
+__attribute__((target("avx2,fma"))) inline size_t buildModelMatricesAVX2(const TransformStore &store, glm::mat4 *out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t end = store.size() / 8 * 8;
+    float *dst = (float *)out;
+
+    for (size_t i = 0; i < end; i += 8)
+    {
+        __m256 x = _mm256_load_ps(&store.rotationX[i]);
+        __m256 y = _mm256_load_ps(&store.rotationY[i]);
+        __m256 z = _mm256_load_ps(&store.rotationZ[i]);
+        __m256 w = _mm256_load_ps(&store.rotationW[i]);
+
+        __m256 sx = _mm256_load_ps(&store.scaleX[i]);
+        __m256 sy = _mm256_load_ps(&store.scaleY[i]);
+        __m256 sz = _mm256_load_ps(&store.scaleZ[i]);
+
+        __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+
+        // 2 * (a * b +- c * d) done as fused multiply-adds
+        __m256 xyPlusWz = _mm256_mul_ps(two, _mm256_fmadd_ps(x, y, _mm256_mul_ps(w, z)));
+        __m256 xyMinusWz = _mm256_mul_ps(two, _mm256_fmsub_ps(x, y, _mm256_mul_ps(w, z)));
+        __m256 xzPlusWy = _mm256_mul_ps(two, _mm256_fmadd_ps(x, z, _mm256_mul_ps(w, y)));
+        __m256 xzMinusWy = _mm256_mul_ps(two, _mm256_fmsub_ps(x, z, _mm256_mul_ps(w, y)));
+        __m256 yzPlusWx = _mm256_mul_ps(two, _mm256_fmadd_ps(y, z, _mm256_mul_ps(w, x)));
+        __m256 yzMinusWx = _mm256_mul_ps(two, _mm256_fmsub_ps(y, z, _mm256_mul_ps(w, x)));
+
+        __m256 c0x = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), sx);
+        __m256 c0y = _mm256_mul_ps(xyPlusWz, sx);
+        __m256 c0z = _mm256_mul_ps(xzMinusWy, sx);
+
+        __m256 c1x = _mm256_mul_ps(xyMinusWz, sy);
+        __m256 c1y = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), sy);
+        __m256 c1z = _mm256_mul_ps(yzPlusWx, sy);
+
+        __m256 c2x = _mm256_mul_ps(xzPlusWy, sz);
+        __m256 c2y = _mm256_mul_ps(yzMinusWx, sz);
+        __m256 c2z = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), sz);
+
+        float *m = dst + i * 16;
+
+        storeColumnAVX2(m, 0, c0x, c0y, c0z, zero);
+        storeColumnAVX2(m, 1, c1x, c1y, c1z, zero);
+        storeColumnAVX2(m, 2, c2x, c2y, c2z, zero);
+        storeColumnAVX2(m, 3, _mm256_load_ps(&store.positionX[i]), _mm256_load_ps(&store.positionY[i]),
+                        _mm256_load_ps(&store.positionZ[i]), one);
+    }
+
+    return end;
+}
+
+#endif
+
+// build every model matrix of the store into out, which must be 16 byte aligned and hold store.size() matrices
+inline void buildModelMatrices(const TransformStore &store, glm::mat4 *out)
+{
+    size_t done = 0;
+
+#if defined(__x86_64__)
+    static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    done = avx2 ? buildModelMatricesAVX2(store, out) : buildModelMatricesSSE(store, out);
+#endif
+
+    // leftovers that don't fill a whole batch
+    buildModelMatricesScalar(store, out, done, store.size());
+}
+
+// build random transforms with every kernel the cpu runs and compare each element to glm's translate * rotate * scale
+//
+// prints the first mismatch of each kernel that fails, returns whether they all matched
+inline bool verify_model_matrices(size_t count = TRANSFORM_VERIFY_COUNT, unsigned int seed = 1)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> angle(-2.0f * (float)M_PI, 2.0f * (float)M_PI);
+    std::uniform_real_distribution<float> axis(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+
+    TransformStore store;
+    std::vector<glm::mat4> expected(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 p(position(random), position(random), position(random));
+        // z stays away from zero so the axis can't degenerate
+        glm::vec3 a(axis(random), axis(random), axis(random) + 2.0f);
+        glm::vec3 s(scale(random), scale(random), scale(random));
+        float radians = angle(random);
+
+        store.add(p, radians, a, s);
+        expected[i] = glm::translate(glm::mat4(1.0f), p) * glm::rotate(glm::mat4(1.0f), radians, a) *
+                      glm::scale(glm::mat4(1.0f), s);
+    }
+
+    struct Kernel
+    {
+        const char *name;
+        size_t (*build)(const TransformStore &, glm::mat4 *);
+    };
+
+    std::vector<Kernel> kernels = {{"scalar", [](const TransformStore &, glm::mat4 *) { return (size_t)0; }}};
+
+#if defined(__x86_64__)
+    kernels.push_back({"sse", buildModelMatricesSSE});
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        kernels.push_back({"avx2", buildModelMatricesAVX2});
+#endif
+
+    bool matched = true;
+    MatrixArray out(count);
+
+    for (const Kernel &kernel : kernels)
+    {
+        // NaN everywhere, so an element a kernel never writes can't pass
+        memset((void *)out.data(), 0xff, count * sizeof(glm::mat4));
+
+        buildModelMatricesScalar(store, out.data(), kernel.build(store, out.data()), count);
+
+        bool failed = false;
+
+        for (size_t i = 0; i < count && !failed; i++)
+        {
+            for (int column = 0; column < 4 && !failed; column++)
+            {
+                for (int row = 0; row < 4 && !failed; row++)
+                {
+                    float value = out[i][column][row];
+                    float reference = expected[i][column][row];
+
+                    if (!(fabsf(value - reference) <= TRANSFORM_VERIFY_TOLERANCE * fmaxf(1.0f, fabsf(reference))))
+                    {
+                        printf("Failed to verify %s transforms: matrix %zu [%d][%d] is %g, glm gives %g\n",
+                               kernel.name, i, column, row, value, reference);
+                        failed = true;
+                    }
+                }
+            }
+        }
+
+        if (!failed)
+            printf("verified %zu %s transforms\n", count, kernel.name);
+
+        matched = matched && !failed;
+    }
+
+    return matched;
+}
+
+#endif
@@ -1,15 +1,361 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include "libs/glad.h"
 #include <GLFW/glfw3.h>
-#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 const float SCREEN_RATIO = 16.0f / 9.0f;
 
+// read-only view of a whole file, memory mapped when possible
+//
+// files mmap can't handle (pipes, empty files, some virtual filesystems) are read into
+// a buffer instead. failures throw std::runtime_error naming the file and the reason.
+class MappedFile
+{
+  public:
+    MappedFile()
+    {
+    }
+
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+
+        struct stat info;
+
+        if (fstat(fd, &info) != 0)
+        {
+            int error = errno;
+            close(fd);
+
+            throw std::runtime_error("Failed to read " + path + ": " + strerror(error));
+        }
+
+        if (S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void *memory = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (memory != MAP_FAILED)
+            {
+                mapping = memory;
+                length = info.st_size;
+                bytes = (const char *)memory;
+
+                // the whole file is about to be consumed front to back, advice values don't combine
+                madvise(memory, length, MADV_SEQUENTIAL);
+                madvise(memory, length, MADV_WILLNEED);
+            }
+        }
+
+        if (mapping == NULL && !readAll(fd, info))
+        {
+            int error = errno;
+            close(fd);
+
+            throw std::runtime_error("Failed to read " + path + ": " + strerror(error));
+        }
+
+        close(fd);
+    }
+
+    MappedFile(MappedFile &&other)
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other)
+    {
+        if (this != &other)
+        {
+            unmap();
+
+            mapping = other.mapping;
+            length = other.length;
+            buffer = std::move(other.buffer);
+            bytes = mapping != NULL ? (const char *)mapping : buffer.data();
+
+            other.mapping = NULL;
+            other.length = 0;
+            other.bytes = NULL;
+        }
+
+        return *this;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+    const char *data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+  private:
+    void *mapping = NULL;
+    size_t length = 0;
+    const char *bytes = NULL;
+    std::vector<char> buffer;
+
+    // buffered fallback, grows geometrically when the size isn't known up front
+    bool readAll(int fd, const struct stat &info)
+    {
+        size_t capacity = S_ISREG(info.st_mode) && info.st_size > 0 ? info.st_size : 64 * 1024;
+        buffer.resize(capacity);
+
+        while (true)
+        {
+            ssize_t count = read(fd, buffer.data() + length, buffer.size() - length);
+
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                return false;
+            }
+
+            if (count == 0)
+                break;
+
+            length += count;
+
+            if (length == buffer.size())
+                buffer.resize(buffer.size() * 2);
+        }
+
+        buffer.resize(length);
+        bytes = buffer.data();
+
+        return true;
+    }
+
+    void unmap()
+    {
+        if (mapping != NULL)
+            munmap(mapping, length);
+
+        mapping = NULL;
+    }
+};
+
+// whole file as a string, throws std::runtime_error when it can't be read
 inline std::string read_file(std::string path_to_file)
 {
-    std::ifstream file(path_to_file);
-    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>{}};
+    MappedFile file(path_to_file);
+    return std::string(file.data(), file.size());
+}
+
+// 64-bit FNV-1a, chain calls by passing the previous result as seed
+inline uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint64_t hash = seed;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+inline uint64_t hash_string(const std::string &value, uint64_t seed = 14695981039346656037ull)
+{
+    // include the terminator so consecutive strings can't shift into each other
+    return hash_bytes(value.c_str(), value.size() + 1, seed);
+}
+
+// create a directory and any missing parents, returns false if it still doesn't exist
+inline bool make_directories(const std::string &path)
+{
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+        mkdir(path.substr(0, slash).c_str(), 0755);
+
+    mkdir(path.c_str(), 0755);
+
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// fold a file's path, size and modification time into key, so it changes whenever the file does
+// without hashing the contents. returns false when the file can't be stat'ed, the path and a zero
+// size still go into the key, which changes once the file shows up
+inline bool hash_file_identity(const std::string &path, uint64_t &key)
+{
+    struct stat info = {};
+    bool found = stat(path.c_str(), &info) == 0;
+
+    int64_t identity[3] = {(int64_t)info.st_size, (int64_t)info.st_mtim.tv_sec, (int64_t)info.st_mtim.tv_nsec};
+
+    key = hash_string(path, key);
+    key = hash_bytes(identity, sizeof(identity), key);
+
+    return found;
+}
+
+// one part of a cache file, written at offset with zeros before it
+struct CacheBlock
+{
+    size_t offset;
+    const void *data;
+    size_t size;
+};
+
+// the first 16 byte aligned offset at or after end, so blocks stay aligned in a mapping
+inline size_t cache_block_offset(size_t end)
+{
+    return (end + 15) / 16 * 16;
+}
+
+// write blocks in increasing offset order to path, returns false if nothing was written
+//
+// the file is written under a temporary name and renamed into place, so a concurrent launch
+// never maps or reads a partial file
+inline bool write_cache_file(const std::string &path, const std::vector<CacheBlock> &blocks)
+{
+    std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+
+    if (file == NULL)
+        return false;
+
+    static const char padding[16] = {};
+    size_t position = 0;
+    bool written = true;
+
+    for (const CacheBlock &block : blocks)
+    {
+        while (written && position < block.offset)
+        {
+            size_t gap = std::min(block.offset - position, sizeof(padding));
+            written = fwrite(padding, 1, gap, file) == gap;
+            position += gap;
+        }
+
+        written = written && fwrite(block.data, 1, block.size, file) == block.size;
+        position += block.size;
+    }
+
+    written = fclose(file) == 0 && written;
+
+    if (written && rename(temporary.c_str(), path.c_str()) == 0)
+        return true;
+
+    remove(temporary.c_str());
+    return false;
+}
+
+// paths of the regular files in a directory in sorted order, empty when it isn't one
+inline std::vector<std::string> list_directory(const std::string &path)
+{
+    std::vector<std::string> files;
+    DIR *directory = opendir(path.c_str());
+
+    if (directory == NULL)
+        return files;
+
+    while (struct dirent *entry = readdir(directory))
+    {
+        std::string file = path + "/" + entry->d_name;
+        struct stat info;
+
+        if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+            files.push_back(file);
+    }
+
+    closedir(directory);
+    std::sort(files.begin(), files.end());
+
+    return files;
+}
+
+// allocator for containers whose storage must be aligned beyond what operator new guarantees
+template <typename T, size_t Alignment> struct AlignedAllocator
+{
+    typedef T value_type;
+
+    template <typename U> struct rebind
+    {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator()
+    {
+    }
+
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment> &)
+    {
+    }
+
+    T *allocate(size_t count)
+    {
+        size_t size = (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        void *memory = aligned_alloc(Alignment, size);
+
+        if (memory == NULL)
+            throw std::bad_alloc();
+
+        return (T *)memory;
+    }
+
+    void deallocate(T *memory, size_t)
+    {
+        free(memory);
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Alignment> &) const
+    {
+        return true;
+    }
+
+    template <typename U> bool operator!=(const AlignedAllocator<U, Alignment> &) const
+    {
+        return false;
+    }
+};
+
+// check the current context for an extension by name
+inline bool has_extension(const char *name)
+{
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return true;
+    }
+
+    return false;
 }
 
 #endif
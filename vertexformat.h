@@ -0,0 +1,304 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include "libs/glad.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// attribute locations shared with the shaders, 2-5 hold the per-instance model matrix
+const unsigned int POSITION_LOCATION = 0;
+const unsigned int TEXCOORD_LOCATION = 1;
+const unsigned int NORMAL_LOCATION = 6;
+
+// positions are stored as half floats only inside this range, which keeps their error under 1/32 unit
+const float HALF_POSITION_LIMIT = 64.0f;
+
+enum class VertexSemantic
+{
+    Position,
+    TexCoord,
+    Normal
+};
+
+// how one attribute is stored in the vertex buffer
+enum class AttributeType
+{
+    Float32,
+    Half,
+    UNorm16,
+    SNorm16,
+    UNorm8,
+    UInt16,
+    UInt8,
+    // three signed normalized 10 bit components plus a 2 bit one in 32 bits
+    SNorm2101010
+};
+
+struct VertexAttribute
+{
+    VertexSemantic semantic;
+    unsigned int location;
+    AttributeType type;
+    int components;
+    unsigned int offset;
+};
+
+// IEEE 754 binary16 with round to nearest even, overflow becomes infinity
+inline uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // nan and infinity
+    if (((bits >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    // subnormal or zero
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return sign;
+
+        mantissa |= 0x800000;
+
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t middle = 1u << (shift - 1);
+
+        if (rest > middle || (rest == middle && (half & 1)))
+            half++;
+
+        return sign | half;
+    }
+
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+
+    // a carry out of the mantissa correctly bumps the exponent
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+
+    return half;
+}
+
+// interleaved vertex layout, generating the matching attribute pointer setup
+class VertexFormat
+{
+  public:
+    std::vector<VertexAttribute> attributes;
+    unsigned int stride = 0;
+
+    VertexFormat &add(VertexSemantic semantic, unsigned int location, AttributeType type, int components)
+    {
+        VertexAttribute attribute = {semantic, location, type, components, stride};
+        attributes.push_back(attribute);
+
+        // keep every attribute 4 byte aligned
+        stride += (attributeSize(type, components) + 3) / 4 * 4;
+
+        return *this;
+    }
+
+    // 32 bit floats everywhere
+    static VertexFormat full(bool normals)
+    {
+        VertexFormat format;
+        format.add(VertexSemantic::Position, POSITION_LOCATION, AttributeType::Float32, 3);
+        format.add(VertexSemantic::TexCoord, TEXCOORD_LOCATION, AttributeType::Float32, 2);
+
+        if (normals)
+            format.add(VertexSemantic::Normal, NORMAL_LOCATION, AttributeType::Float32, 3);
+
+        return format;
+    }
+
+    // smallest types that hold the data: half positions, 16 bit normalized uvs and packed normals
+    static VertexFormat compact(bool normals, float maxPosition, bool uvsInUnitRange)
+    {
+        VertexFormat format;
+
+        if (maxPosition <= HALF_POSITION_LIMIT)
+            format.add(VertexSemantic::Position, POSITION_LOCATION, AttributeType::Half, 4);
+        else
+            format.add(VertexSemantic::Position, POSITION_LOCATION, AttributeType::Float32, 3);
+
+        if (uvsInUnitRange)
+            format.add(VertexSemantic::TexCoord, TEXCOORD_LOCATION, AttributeType::UNorm16, 2);
+        else
+            format.add(VertexSemantic::TexCoord, TEXCOORD_LOCATION, AttributeType::Half, 2);
+
+        if (normals)
+            format.add(VertexSemantic::Normal, NORMAL_LOCATION, AttributeType::SNorm2101010, 4);
+
+        return format;
+    }
+
+    // point the attributes of the bound VAO at the bound GL_ARRAY_BUFFER
+    void setup(size_t baseOffset = 0) const
+    {
+        for (const VertexAttribute &attribute : attributes)
+        {
+            void *pointer = (void *)(baseOffset + attribute.offset);
+
+            if (isInteger(attribute.type))
+            {
+                glVertexAttribIPointer(attribute.location, attribute.components, glType(attribute.type), stride,
+                                       pointer);
+            }
+            else
+            {
+                glVertexAttribPointer(attribute.location, attribute.components, glType(attribute.type),
+                                      isNormalized(attribute.type), stride, pointer);
+            }
+
+            glEnableVertexAttribArray(attribute.location);
+        }
+    }
+
+    // encode one vertex into stride bytes at out, missing components are 0 (w is 1)
+    void pack(const glm::vec3 &position, const glm::vec2 &uv, const glm::vec3 &normal, unsigned char *out) const
+    {
+        memset(out, 0, stride);
+
+        for (const VertexAttribute &attribute : attributes)
+        {
+            float values[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+            if (attribute.semantic == VertexSemantic::Position)
+                values[0] = position.x, values[1] = position.y, values[2] = position.z;
+            else if (attribute.semantic == VertexSemantic::TexCoord)
+                values[0] = uv.x, values[1] = uv.y;
+            else
+                values[0] = normal.x, values[1] = normal.y, values[2] = normal.z, values[3] = 0.0f;
+
+            packAttribute(attribute, values, out + attribute.offset);
+        }
+    }
+
+  private:
+    static void packAttribute(const VertexAttribute &attribute, const float *values, unsigned char *out)
+    {
+        switch (attribute.type)
+        {
+        case AttributeType::Float32:
+            memcpy(out, values, attribute.components * sizeof(float));
+            break;
+
+        case AttributeType::Half:
+            for (int i = 0; i < attribute.components; i++)
+                store16(out + i * 2, float_to_half(values[i]));
+            break;
+
+        case AttributeType::UNorm16:
+            for (int i = 0; i < attribute.components; i++)
+                store16(out + i * 2, (uint16_t)lroundf(glm::clamp(values[i], 0.0f, 1.0f) * 65535.0f));
+            break;
+
+        case AttributeType::SNorm16:
+            for (int i = 0; i < attribute.components; i++)
+                store16(out + i * 2, (uint16_t)(int16_t)lroundf(glm::clamp(values[i], -1.0f, 1.0f) * 32767.0f));
+            break;
+
+        case AttributeType::UInt16:
+            for (int i = 0; i < attribute.components; i++)
+                store16(out + i * 2, (uint16_t)values[i]);
+            break;
+
+        case AttributeType::UNorm8:
+            for (int i = 0; i < attribute.components; i++)
+                out[i] = (uint8_t)lroundf(glm::clamp(values[i], 0.0f, 1.0f) * 255.0f);
+            break;
+
+        case AttributeType::UInt8:
+            for (int i = 0; i < attribute.components; i++)
+                out[i] = (uint8_t)values[i];
+            break;
+
+        case AttributeType::SNorm2101010:
+        {
+            uint32_t packed = 0;
+
+            for (int i = 0; i < 3; i++)
+                packed |= ((uint32_t)lroundf(glm::clamp(values[i], -1.0f, 1.0f) * 511.0f) & 0x3ff) << (i * 10);
+
+            packed |= ((uint32_t)lroundf(glm::clamp(values[3], -1.0f, 1.0f)) & 0x3) << 30;
+            memcpy(out, &packed, 4);
+            break;
+        }
+        }
+    }
+
+    static void store16(unsigned char *out, uint16_t value)
+    {
+        memcpy(out, &value, sizeof(value));
+    }
+
+    static unsigned int attributeSize(AttributeType type, int components)
+    {
+        switch (type)
+        {
+        case AttributeType::Float32:
+            return 4 * components;
+        case AttributeType::Half:
+        case AttributeType::UNorm16:
+        case AttributeType::SNorm16:
+        case AttributeType::UInt16:
+            return 2 * components;
+        case AttributeType::UNorm8:
+        case AttributeType::UInt8:
+            return components;
+        case AttributeType::SNorm2101010:
+            return 4;
+        }
+
+        return 0;
+    }
+
+    static GLenum glType(AttributeType type)
+    {
+        switch (type)
+        {
+        case AttributeType::Float32:
+            return GL_FLOAT;
+        case AttributeType::Half:
+            return GL_HALF_FLOAT;
+        case AttributeType::UNorm16:
+        case AttributeType::UInt16:
+            return GL_UNSIGNED_SHORT;
+        case AttributeType::SNorm16:
+            return GL_SHORT;
+        case AttributeType::UNorm8:
+        case AttributeType::UInt8:
+            return GL_UNSIGNED_BYTE;
+        case AttributeType::SNorm2101010:
+            return GL_INT_2_10_10_10_REV;
+        }
+
+        return GL_FLOAT;
+    }
+
+    static bool isInteger(AttributeType type)
+    {
+        return type == AttributeType::UInt16 || type == AttributeType::UInt8;
+    }
+
+    static GLboolean isNormalized(AttributeType type)
+    {
+        return type == AttributeType::UNorm16 || type == AttributeType::SNorm16 || type == AttributeType::UNorm8 ||
+               type == AttributeType::SNorm2101010;
+    }
+};
+
+#endif